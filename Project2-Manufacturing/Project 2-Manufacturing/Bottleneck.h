@@ -0,0 +1,154 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Online shifting-bottleneck detection by the active period method (Roser et al.). A stage is
+// active while it holds up work: products wait in its queue, or it is processing with no spare
+// capacity. At any moment the bottleneck is the stage whose current active period started
+// first. While the bottleneck hands over to the next one, i.e. where their active periods
+// overlap, both are shifting bottlenecks; otherwise it is the sole bottleneck.
+// The bottleneck only changes when it goes inactive, so each state change costs O(stages)
+// and time is credited per period (one shift by default) without keeping the active periods.
+class BottleneckDetector {
+private:
+    int stageCount = 0;
+    double periodLength = 8.0;
+    std::vector<double> activeSince; // start of each stage's active period, -1 while inactive
+    int bottleneck = -1;
+    double bottleneckSince = 0.0; // when the current bottleneck took over
+    double creditedUntil = 0.0;
+    std::vector<double> sole; // period * stageCount + stage
+    std::vector<double> shifting;
+
+    // Adds `amount` per hour of [from, to) to `table`, split over the periods it spans
+    void credit(std::vector<double>& table, int stage, double from, double to, double amount) {
+        while (from < to) {
+            size_t period = static_cast<size_t>(from / periodLength);
+            double end = std::min(to, (period + 1) * periodLength);
+            if (table.size() < (period + 1) * stageCount) {
+                sole.resize((period + 1) * stageCount, 0.0);
+                shifting.resize((period + 1) * stageCount, 0.0);
+            }
+            table[period * stageCount + stage] += amount * (end - from);
+            from = end;
+        }
+    }
+
+    void advance(double now) {
+        if (bottleneck >= 0 && now > creditedUntil) {
+            credit(sole, bottleneck, creditedUntil, now, 1.0);
+        }
+        creditedUntil = std::max(creditedUntil, now);
+    }
+
+    static double total(const std::vector<double>& table, int stageCount, int stage) {
+        double sum = 0.0;
+        for (size_t i = stage; i < table.size(); i += stageCount) {
+            sum += table[i];
+        }
+        return sum;
+    }
+
+public:
+    void reset(int stages, double period) {
+        stageCount = stages;
+        periodLength = period > 0.0 ? period : 8.0;
+        activeSince.assign(stages, -1.0);
+        bottleneck = -1;
+        bottleneckSince = 0.0;
+        creditedUntil = 0.0;
+        sole.clear();
+        shifting.clear();
+    }
+
+    // Records a stage's state as of `now`; only changes do any work
+    void update(int stage, bool active, double now) {
+        if (active == (activeSince[stage] >= 0.0)) {
+            return;
+        }
+        advance(now);
+        if (active) {
+            activeSince[stage] = now;
+            if (bottleneck < 0) {
+                bottleneck = stage;
+                bottleneckSince = now;
+            }
+            return;
+        }
+        activeSince[stage] = -1.0;
+        if (stage != bottleneck) {
+            return;
+        }
+        int next = -1;
+        for (int other = 0; other < stageCount; other++) {
+            if (activeSince[other] >= 0.0 && (next < 0 || activeSince[other] < activeSince[next])) {
+                next = other;
+            }
+        }
+        if (next >= 0) {
+            // The overlap with the next bottleneck was credited to the old one as sole time
+            double overlapStart = std::max(activeSince[next], bottleneckSince);
+            credit(sole, stage, overlapStart, now, -1.0);
+            credit(shifting, stage, overlapStart, now, 1.0);
+            credit(shifting, next, overlapStart, now, 1.0);
+        }
+        bottleneck = next;
+        bottleneckSince = now;
+    }
+
+    // Credits the running bottleneck up to the end of the run
+    void finish(double now) {
+        advance(now);
+    }
+
+    double soleTime(int stage) const {
+        return total(sole, stageCount, stage);
+    }
+
+    double shiftingTime(int stage) const {
+        return total(shifting, stageCount, stage);
+    }
+
+    // Stages ranked by sole, then shifting bottleneck time, then the bottleneck of each period
+    template <typename StageName>
+    void report(std::ostream& out, double runTime, const StageName& stageName) const {
+        std::vector<int> order(stageCount);
+        for (int stage = 0; stage < stageCount; stage++) {
+            order[stage] = stage;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+            return soleTime(a) != soleTime(b) ? soleTime(a) > soleTime(b) : shiftingTime(a) > shiftingTime(b);
+        });
+        double percent = runTime > 0.0 ? 100.0 / runTime : 0.0;
+        for (int rank = 0; rank < stageCount; rank++) {
+            int stage = order[rank];
+            out << rank + 1 << ". " << stageName(stage) << ": sole " << soleTime(stage) << " time units (" << soleTime(stage) * percent
+                << " %), shifting " << shiftingTime(stage) << " time units (" << shiftingTime(stage) * percent << " %)\n";
+        }
+        out << "Bottleneck per " << periodLength << " time unit period:\n";
+        size_t periods = stageCount > 0 ? sole.size() / stageCount : 0;
+        char range[64];
+        for (size_t period = 0; period < periods; period++) {
+            int best = -1;
+            double bestTime = 0.0;
+            for (int stage = 0; stage < stageCount; stage++) {
+                double time = sole[period * stageCount + stage] + shifting[period * stageCount + stage];
+                if (time > bestTime) {
+                    best = stage;
+                    bestTime = time;
+                }
+            }
+            std::snprintf(range, sizeof(range), "%g-%g: ", period * periodLength, (period + 1) * periodLength);
+            out << range;
+            if (best < 0) {
+                out << "none\n";
+            }
+            else {
+                out << stageName(best) << " (sole " << sole[period * stageCount + best] << ", shifting " << shifting[period * stageCount + best] << ")\n";
+            }
+        }
+    }
+};
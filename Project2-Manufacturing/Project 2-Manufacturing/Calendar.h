@@ -0,0 +1,248 @@
+﻿#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+// A working period inside the repeating calendar cycle (times in hours)
+struct ShiftWindow {
+    double start;
+    double length;
+    std::map<std::string, int> capacity; // units of each resource on duty during the shift
+};
+
+// Break taken inside every shift, relative to the shift start; it takes away that shift's crew only
+struct BreakWindow {
+    double offset;
+    double length;
+    std::vector<std::string> resources; // empty means every resource on the shift
+};
+
+// Per-resource off period inside the cycle, e.g. planned maintenance every Monday morning
+struct OffWindow {
+    std::string resource;
+    double start;
+    double length;
+};
+
+// Parses a crew written as "<resource>=<units>[,<resource>=<units>...]", e.g. "operators=5,machines=8"
+inline bool parseCrew(const std::string& text, std::map<std::string, int>& crew) {
+    crew.clear();
+    size_t begin = 0;
+    while (begin <= text.size()) {
+        size_t end = std::min(text.find(',', begin), text.size());
+        size_t equals = text.find('=', begin);
+        if (equals == std::string::npos || equals <= begin || equals + 1 >= end) {
+            return false;
+        }
+        char* parsedEnd = nullptr;
+        std::string units = text.substr(equals + 1, end - equals - 1);
+        long value = std::strtol(units.c_str(), &parsedEnd, 10);
+        if (*parsedEnd != '\0' || value < 0) {
+            return false;
+        }
+        crew[text.substr(begin, equals - begin)] = static_cast<int>(value);
+        begin = end + 1;
+    }
+    return true;
+}
+
+// One entry of the compiled interval table: from `time` on, `resource` has `capacity` units on duty
+struct CapacityChange {
+    double time;
+    std::string resource;
+    int capacity;
+};
+
+class ShiftCalendar {
+private:
+    double cycleLength = 24.0;
+    std::vector<ShiftWindow> shifts;
+    std::vector<BreakWindow> breaks;
+    std::vector<OffWindow> offWindows;
+    std::vector<int> nonWorkingDays; // day of week, 0 = first day of the run
+
+    struct Boundary {
+        double time;
+        int shiftDelta;
+        int blockDelta;
+    };
+
+    // Day of week of `time`, also for shifts before the run in cycles longer than a week
+    bool isWorkingDay(double time) const {
+        double week = std::fmod(time, 7 * 24.0);
+        if (week < 0.0) {
+            week += 7 * 24.0;
+        }
+        int day = std::min(static_cast<int>(week / 24.0), 6); // week can round up to 168
+        return std::find(nonWorkingDays.begin(), nonWorkingDays.end(), day) == nonWorkingDays.end();
+    }
+
+    static bool appliesTo(const std::vector<std::string>& names, const std::string& resource) {
+        return names.empty() || std::find(names.begin(), names.end(), resource) != names.end();
+    }
+
+public:
+    // Length of the repeating pattern; use 168 for weekly patterns or 504 for a 3-week rotation
+    void setCycleLength(double hours) {
+        cycleLength = hours;
+    }
+
+    void addShift(double start, double length, const std::map<std::string, int>& capacity) {
+        shifts.push_back({ start, length, capacity });
+    }
+
+    // Fills the cycle with `shiftsPerDay` back-to-back shifts starting at `firstStart` each day.
+    // The crew working shift s on day d is crews[(s + d / rotateEveryDays) % crews.size()], so
+    // three crews with rotateEveryDays = 7 give the usual weekly rotating 3-shift pattern.
+    void addDailyShifts(double firstStart, double shiftLength, int shiftsPerDay,
+        const std::vector<std::map<std::string, int>>& crews, int rotateEveryDays = 7) {
+        if (crews.empty() || rotateEveryDays <= 0) {
+            return;
+        }
+        int days = static_cast<int>(std::ceil(cycleLength / 24.0));
+        for (int day = 0; day < days; day++) {
+            for (int shift = 0; shift < shiftsPerDay; shift++) {
+                size_t crew = static_cast<size_t>(shift + day / rotateEveryDays) % crews.size();
+                addShift(day * 24.0 + firstStart + shift * shiftLength, shiftLength, crews[crew]);
+            }
+        }
+    }
+
+    void addBreak(double offset, double length, const std::vector<std::string>& resources = {}) {
+        breaks.push_back({ offset, length, resources });
+    }
+
+    void addOffWindow(const std::string& resource, double start, double length) {
+        offWindows.push_back({ resource, start, length });
+    }
+
+    void setNonWorkingDays(const std::vector<int>& days) {
+        nonWorkingDays = days;
+    }
+
+    bool empty() const {
+        return shifts.empty() && offWindows.empty();
+    }
+
+    // Exact text form of the pattern: equal calendars give equal strings (used in cache keys)
+    std::string canonical() const {
+        std::string text;
+        char number[48];
+        auto add = [&](double value) {
+            std::snprintf(number, sizeof(number), "%.17g,", value);
+            text += number;
+        };
+        text += "cycle:";
+        add(cycleLength);
+        for (const auto& shift : shifts) {
+            text += "shift:";
+            add(shift.start);
+            add(shift.length);
+            for (const auto& entry : shift.capacity) {
+                text += entry.first + "=" + std::to_string(entry.second) + ",";
+            }
+        }
+        for (const auto& pause : breaks) {
+            text += "break:";
+            add(pause.offset);
+            add(pause.length);
+            for (const auto& name : pause.resources) {
+                text += name + ",";
+            }
+        }
+        for (const auto& off : offWindows) {
+            text += "off:" + off.resource + ",";
+            add(off.start);
+            add(off.length);
+        }
+        text += "closed:";
+        for (int day : nonWorkingDays) {
+            text += std::to_string(day) + ",";
+        }
+        return text;
+    }
+
+    // Expands the pattern over [0, horizon) into a time-sorted table of capacity changes.
+    // Resources that no shift mentions keep their base capacity apart from their off windows.
+    std::vector<CapacityChange> compile(const std::map<std::string, int>& baseCapacity, double horizon) const {
+        std::vector<CapacityChange> table;
+        if (cycleLength <= 0.0) {
+            return table;
+        }
+
+        for (const auto& resource : baseCapacity) {
+            bool calendared = false;
+            for (const auto& shift : shifts) {
+                calendared = calendared || shift.capacity.count(resource.first) > 0;
+            }
+
+            std::vector<Boundary> boundaries;
+            if (calendared) {
+                boundaries.push_back({ 0.0, 0, 0 }); // calendared resources start off duty until a shift opens
+            }
+            // Start one cycle early so shifts wrapping over midnight of the first cycle are seen
+            for (double cycleStart = -cycleLength; cycleStart < horizon; cycleStart += cycleLength) {
+                for (const auto& shift : shifts) {
+                    auto it = shift.capacity.find(resource.first);
+                    double start = cycleStart + shift.start;
+                    if (it == shift.capacity.end() || !isWorkingDay(start)) {
+                        continue;
+                    }
+                    boundaries.push_back({ start, it->second, 0 });
+                    boundaries.push_back({ start + shift.length, -it->second, 0 });
+                    for (const auto& pause : breaks) {
+                        // Clipped to the shift, so a crew is never taken off duty twice
+                        double pauseStart = start + std::min(std::max(pause.offset, 0.0), shift.length);
+                        double pauseEnd = start + std::min(std::max(pause.offset + pause.length, 0.0), shift.length);
+                        if (appliesTo(pause.resources, resource.first) && pauseEnd > pauseStart) {
+                            boundaries.push_back({ pauseStart, -it->second, 0 });
+                            boundaries.push_back({ pauseEnd, it->second, 0 });
+                        }
+                    }
+                }
+                for (const auto& off : offWindows) {
+                    if (off.resource == resource.first) {
+                        boundaries.push_back({ cycleStart + off.start, 0, 1 });
+                        boundaries.push_back({ cycleStart + off.start + off.length, 0, -1 });
+                    }
+                }
+            }
+            std::sort(boundaries.begin(), boundaries.end(),
+                [](const Boundary& a, const Boundary& b) { return a.time < b.time; });
+
+            int onShift = 0;
+            int blocked = 0;
+            int current = -1;
+            for (size_t i = 0; i < boundaries.size();) {
+                double time = boundaries[i].time;
+                for (; i < boundaries.size() && boundaries[i].time == time; i++) {
+                    onShift += boundaries[i].shiftDelta;
+                    blocked += boundaries[i].blockDelta;
+                }
+                if (time >= horizon) {
+                    break;
+                }
+                int capacity = blocked > 0 ? 0 : (calendared ? std::max(onShift, 0) : resource.second);
+                if (capacity != current) {
+                    // Changes before the run starts collapse into the initial capacity at time 0
+                    double at = std::max(time, 0.0);
+                    if (!table.empty() && table.back().resource == resource.first && table.back().time == at) {
+                        table.back().capacity = capacity;
+                    }
+                    else {
+                        table.push_back({ at, resource.first, capacity });
+                    }
+                    current = capacity;
+                }
+            }
+        }
+
+        std::stable_sort(table.begin(), table.end(),
+            [](const CapacityChange& a, const CapacityChange& b) { return a.time < b.time; });
+        return table;
+    }
+};
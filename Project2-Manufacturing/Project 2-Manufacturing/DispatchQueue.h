@@ -0,0 +1,240 @@
+﻿#pragma once
+#include <memory_resource>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Random.h"
+
+enum class DispatchRule { FIFO, SPT, EDD, WSPT, ATC };
+
+inline bool parseDispatchRule(const std::string& name, DispatchRule& rule) {
+    if (name == "FIFO") rule = DispatchRule::FIFO;
+    else if (name == "SPT") rule = DispatchRule::SPT;
+    else if (name == "EDD") rule = DispatchRule::EDD;
+    else if (name == "WSPT") rule = DispatchRule::WSPT;
+    else if (name == "ATC") rule = DispatchRule::ATC;
+    else return false;
+    return true;
+}
+
+// Binary min-heap of handles ordered by (key, sequence), with the position of every handle
+// tracked so entries can be removed from the middle in O(log n)
+class IndexedHeap {
+private:
+    struct Entry {
+        double key;
+        long long sequence;
+        int handle;
+    };
+    std::pmr::vector<Entry> heap;
+    std::pmr::vector<int> position; // heap index per handle, -1 if absent
+
+    static bool before(const Entry& a, const Entry& b) {
+        return a.key < b.key || (a.key == b.key && a.sequence < b.sequence);
+    }
+
+    void place(size_t index, const Entry& entry) {
+        heap[index] = entry;
+        position[entry.handle] = static_cast<int>(index);
+    }
+
+    void siftUp(size_t index) {
+        Entry entry = heap[index];
+        while (index > 0) {
+            size_t parent = (index - 1) / 2;
+            if (!before(entry, heap[parent])) {
+                break;
+            }
+            place(index, heap[parent]);
+            index = parent;
+        }
+        place(index, entry);
+    }
+
+    void siftDown(size_t index) {
+        Entry entry = heap[index];
+        for (;;) {
+            size_t child = 2 * index + 1;
+            if (child >= heap.size()) {
+                break;
+            }
+            if (child + 1 < heap.size() && before(heap[child + 1], heap[child])) {
+                child++;
+            }
+            if (!before(heap[child], entry)) {
+                break;
+            }
+            place(index, heap[child]);
+            index = child;
+        }
+        place(index, entry);
+    }
+
+public:
+    explicit IndexedHeap(std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+        : heap(memory), position(memory) {
+    }
+
+    void push(int handle, double key, long long sequence) {
+        if (handle >= static_cast<int>(position.size())) {
+            position.resize(handle + 1, -1);
+        }
+        heap.push_back({ key, sequence, handle });
+        position[handle] = static_cast<int>(heap.size()) - 1;
+        siftUp(heap.size() - 1);
+    }
+
+    void remove(int handle) {
+        size_t index = position[handle];
+        position[handle] = -1;
+        Entry last = heap.back();
+        heap.pop_back();
+        if (index < heap.size()) {
+            place(index, last);
+            siftUp(index);
+            siftDown(position[last.handle]);
+        }
+    }
+
+    int top() const {
+        return heap.front().handle;
+    }
+
+    double topKey() const {
+        return heap.front().key;
+    }
+
+    long long topSequence() const {
+        return heap.front().sequence;
+    }
+
+    bool empty() const {
+        return heap.empty();
+    }
+
+    void clear() {
+        heap.clear();
+        position.clear();
+    }
+};
+
+// Stage queue that hands out jobs in the order of a dispatching rule in O(log n).
+// ATC is kept exact without re-keying: while a job still has slack its index is a static key
+// plus t / (k * pbar), so only jobs reaching their latest start time move to a second heap.
+// Its keys use portableLog, so near-ties between jobs break the same way on every platform.
+template <typename Job>
+class DispatchQueue {
+private:
+    struct Slot {
+        Job job;
+        double processTime;
+        double dueDate;
+        double weight;
+    };
+    DispatchRule rule = DispatchRule::FIFO;
+    double atcScale = 1.0; // k * average processing time
+    std::pmr::vector<Slot> slots;
+    std::pmr::vector<int> freeSlots;
+    IndexedHeap primary;
+    IndexedHeap critical; // ATC: jobs past their latest start, keyed by -log(w/p)
+    IndexedHeap latestStart; // ATC: jobs with slack, keyed by d - p
+    long long sequence = 0;
+    size_t count = 0;
+
+    double key(const Slot& slot) const {
+        switch (rule) {
+        case DispatchRule::SPT: return slot.processTime;
+        case DispatchRule::EDD: return slot.dueDate;
+        case DispatchRule::WSPT: return -slot.weight / slot.processTime;
+        case DispatchRule::ATC: return -(portableLog(slot.weight / slot.processTime) - (slot.dueDate - slot.processTime) / atcScale);
+        default: return 0.0;
+        }
+    }
+
+public:
+    explicit DispatchQueue(std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+        : slots(memory), freeSlots(memory), primary(memory), critical(memory), latestStart(memory) {
+    }
+
+    // `k` is the ATC look-ahead parameter and `averageProcessTime` the station's mean processing time
+    void setRule(DispatchRule newRule, double k = 2.0, double averageProcessTime = 1.0) {
+        rule = newRule;
+        atcScale = k * averageProcessTime > 0.0 ? k * averageProcessTime : 1.0;
+    }
+
+    DispatchRule getRule() const {
+        return rule;
+    }
+
+    void push(const Job& job, double processTime, double dueDate, double weight = 1.0) {
+        int handle;
+        Slot slot = { job, processTime > 0.0 ? processTime : 1e-9, dueDate, weight };
+        if (freeSlots.empty()) {
+            handle = static_cast<int>(slots.size());
+            slots.push_back(slot);
+        }
+        else {
+            handle = freeSlots.back();
+            freeSlots.pop_back();
+            slots[handle] = slot;
+        }
+        primary.push(handle, key(slot), sequence);
+        if (rule == DispatchRule::ATC) {
+            latestStart.push(handle, slot.dueDate - slot.processTime, sequence);
+        }
+        sequence++;
+        count++;
+    }
+
+    Job pop(double now) {
+        int handle;
+        if (rule == DispatchRule::ATC) {
+            while (!latestStart.empty() && latestStart.topKey() <= now) {
+                int late = latestStart.top();
+                latestStart.remove(late);
+                primary.remove(late);
+                critical.push(late, -portableLog(slots[late].weight / slots[late].processTime), sequence++);
+            }
+            bool fromCritical = primary.empty();
+            if (!primary.empty() && !critical.empty()) {
+                double slackIndex = -primary.topKey() + now / atcScale;
+                double lateIndex = -critical.topKey();
+                fromCritical = lateIndex > slackIndex;
+            }
+            if (fromCritical) {
+                handle = critical.top();
+                critical.remove(handle);
+            }
+            else {
+                handle = primary.top();
+                primary.remove(handle);
+                latestStart.remove(handle);
+            }
+        }
+        else {
+            handle = primary.top();
+            primary.remove(handle);
+        }
+        freeSlots.push_back(handle);
+        count--;
+        return std::move(slots[handle].job);
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    void clear() {
+        slots.clear();
+        freeSlots.clear();
+        primary.clear();
+        critical.clear();
+        latestStart.clear();
+        sequence = 0;
+        count = 0;
+    }
+};
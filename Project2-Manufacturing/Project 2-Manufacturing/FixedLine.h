@@ -0,0 +1,278 @@
+﻿#pragma once
+#include <array>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "Random.h"
+#include "ResultsWriter.h"
+
+// Compile-time description of a flow line whose routing never changes. A line is a struct with
+//   enum Pool { ..., PoolCount };            resource pools, plus poolNames[PoolCount]
+//   typedef std::tuple<Stage types...> Stages;    in routing order, each with a static name
+//   typedef std::tuple<Product types...> Products; each with name, arrivalRate and processing
+// and FixedLineSystem<Line> runs it with every stage, pool index and routing step resolved by
+// the compiler: no strings, maps or std::function on the event path.
+
+// `Units` of pool `Pool` held while a stage runs
+template <int Pool, int Units>
+struct Uses {
+    static constexpr int pool = Pool;
+    static constexpr int units = Units;
+};
+
+template <typename... Demands>
+struct Stage {
+    template <typename Pools>
+    static bool canSeize(const Pools& available) {
+        return ((available[Demands::pool] >= Demands::units) && ...);
+    }
+
+    template <typename Pools>
+    static void seize(Pools& available) {
+        ((available[Demands::pool] -= Demands::units), ...);
+    }
+
+    template <typename Pools>
+    static void release(Pools& available) {
+        ((available[Demands::pool] += Demands::units), ...);
+    }
+
+    template <typename Times>
+    static void addUsage(Times& usageTime, [[maybe_unused]] double processTime) {
+        ((usageTime[Demands::pool] += Demands::units * processTime), ...);
+    }
+
+    static constexpr bool uses([[maybe_unused]] int pool) {
+        return ((Demands::pool == pool) || ...);
+    }
+
+    // True if releasing this stage's resources can unblock `Other`
+    template <typename Other>
+    static constexpr bool feeds() {
+        return (Other::uses(Demands::pool) || ...);
+    }
+};
+
+template <typename Line>
+class FixedLineSystem {
+public:
+    typedef typename Line::Stages Stages;
+    typedef typename Line::Products Products;
+    static constexpr int stageCount = static_cast<int>(std::tuple_size<Stages>::value);
+    static constexpr int productCount = static_cast<int>(std::tuple_size<Products>::value);
+    static constexpr int poolCount = Line::PoolCount;
+
+private:
+    template <int S> using StageAt = std::tuple_element_t<S, Stages>;
+    template <int P> using ProductAt = std::tuple_element_t<P, Products>;
+    typedef void (FixedLineSystem::*Handler)(int);
+
+    struct Event {
+        double time;
+        long long sequence;
+        Handler handler;
+        int job;
+
+        bool operator>(const Event& other) const {
+            return time > other.time || (time == other.time && sequence > other.sequence);
+        }
+    };
+
+    struct Job {
+        int product;
+        double dueDate;
+        double queuedSince;
+    };
+
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> eventQueue;
+    std::vector<Job> jobs;
+    std::vector<int> freeJobs;
+    std::array<std::deque<int>, stageCount> queues;
+    std::array<int, poolCount> capacity{};
+    std::array<int, poolCount> available{};
+    std::array<double, poolCount> usageTime{};
+    std::array<double, stageCount> waitingTime{};
+    std::array<long long, productCount> finished{};
+    long long tardyProducts = 0;
+    double totalTardiness = 0.0;
+    double dueDateFactor = 3.0; // due date = arrival + factor * total processing time
+    double currentTime = 0.0;
+    long long sequence = 0;
+    long long eventsProcessed = 0;
+    RandomStream random;
+    unsigned long long seed = 0;
+
+    template <int P>
+    static constexpr double routeLength() {
+        double total = 0.0;
+        for (double time : ProductAt<P>::processing) {
+            total += time;
+        }
+        return total;
+    }
+
+    // Processing time of a runtime product at a compile-time stage
+    template <int S, int... P>
+    static double processTime(int product, std::integer_sequence<int, P...>) {
+        static constexpr double times[] = { ProductAt<P>::processing[S]... };
+        return times[product];
+    }
+
+    void schedule(double time, Handler handler, int job) {
+        eventQueue.push({ time, sequence++, handler, job });
+    }
+
+    template <int P>
+    void arrive(int) {
+        schedule(currentTime + random.exponential(ProductAt<P>::arrivalRate), &FixedLineSystem::arrive<P>, -1);
+        int job;
+        if (freeJobs.empty()) {
+            job = static_cast<int>(jobs.size());
+            jobs.push_back(Job());
+        }
+        else {
+            job = freeJobs.back();
+            freeJobs.pop_back();
+        }
+        jobs[job] = { P, currentTime + dueDateFactor * routeLength<P>(), 0.0 };
+        enqueue<0>(job);
+    }
+
+    template <int S>
+    void enqueue(int job) {
+        jobs[job].queuedSince = currentTime;
+        queues[S].push_back(job);
+        startWaiting<S>();
+    }
+
+    template <int S>
+    void startWaiting() {
+        while (!queues[S].empty() && StageAt<S>::canSeize(available)) {
+            StageAt<S>::seize(available);
+            int job = queues[S].front();
+            queues[S].pop_front();
+            double time = processTime<S>(jobs[job].product, std::make_integer_sequence<int, productCount>());
+            waitingTime[S] += currentTime - jobs[job].queuedSince;
+            StageAt<S>::addUsage(usageTime, time);
+            schedule(currentTime + time, &FixedLineSystem::complete<S>, job);
+        }
+    }
+
+    // Retries, in routing order, only the stages that share a pool with stage S
+    template <int S, int... T>
+    void wake(std::integer_sequence<int, T...>) {
+        ((StageAt<S>::template feeds<StageAt<T>>() ? startWaiting<T>() : void()), ...);
+    }
+
+    template <int S>
+    void complete(int job) {
+        StageAt<S>::release(available);
+        wake<S>(std::make_integer_sequence<int, stageCount>());
+        if constexpr (S + 1 < stageCount) {
+            enqueue<S + 1>(job);
+        }
+        else {
+            finished[jobs[job].product]++;
+            if (currentTime > jobs[job].dueDate) {
+                tardyProducts++;
+                totalTardiness += currentTime - jobs[job].dueDate;
+            }
+            freeJobs.push_back(job);
+        }
+    }
+
+    template <int... P>
+    void startArrivals(std::integer_sequence<int, P...>) {
+        ((ProductAt<P>::arrivalRate > 0.0
+            ? schedule(random.exponential(ProductAt<P>::arrivalRate), &FixedLineSystem::arrive<P>, -1)
+            : void()), ...);
+    }
+
+    template <int... P>
+    void addProductKpis(KpiVector& kpis, std::integer_sequence<int, P...>) const {
+        (kpis.push_back({ std::string("finished.") + ProductAt<P>::name, static_cast<double>(finished[P]) }), ...);
+    }
+
+    template <int... S>
+    void addStageKpis(KpiVector& kpis, const char* prefix, bool queueLengths, std::integer_sequence<int, S...>) const {
+        (kpis.push_back({ prefix + std::string(StageAt<S>::name), queueLengths ? static_cast<double>(queues[S].size()) : waitingTime[S] }), ...);
+    }
+
+    template <int... P>
+    static constexpr bool routesMatch(std::integer_sequence<int, P...>) {
+        return ((std::tuple_size<decltype(ProductAt<P>::processing)>::value == static_cast<size_t>(stageCount)) && ...);
+    }
+
+    static_assert(routesMatch(std::make_integer_sequence<int, productCount>()), "every product needs one processing time per stage");
+
+public:
+    explicit FixedLineSystem(const std::array<int, poolCount>& units, unsigned long long newSeed = 0) {
+        capacity = units;
+        reset(newSeed);
+    }
+
+    // Same contract as ManufacturingSystem::reset: a fresh run with the buffers kept
+    void reset(unsigned long long newSeed) {
+        while (!eventQueue.empty()) {
+            eventQueue.pop();
+        }
+        for (auto& queue : queues) {
+            queue.clear();
+        }
+        jobs.clear();
+        freeJobs.clear();
+        available = capacity;
+        usageTime.fill(0.0);
+        waitingTime.fill(0.0);
+        finished.fill(0);
+        tardyProducts = 0;
+        totalTardiness = 0.0;
+        currentTime = 0.0;
+        sequence = 0;
+        eventsProcessed = 0;
+        seed = newSeed;
+        random.seed(seed);
+    }
+
+    void runSimulation(double runTime) {
+        startArrivals(std::make_integer_sequence<int, productCount>());
+        while (!eventQueue.empty() && currentTime < runTime) {
+            Event currentEvent = eventQueue.top();
+            eventQueue.pop();
+            currentTime = currentEvent.time;
+            (this->*currentEvent.handler)(currentEvent.job);
+            eventsProcessed++;
+        }
+    }
+
+    unsigned long long getSeed() const {
+        return seed;
+    }
+
+    long long getEventsProcessed() const {
+        return eventsProcessed;
+    }
+
+    // Same KPI names as ManufacturingSystem::getKpis for the fields a fixed line has
+    KpiVector getKpis() const {
+        KpiVector kpis;
+        long long total = 0;
+        for (long long count : finished) {
+            total += count;
+        }
+        kpis.push_back({ "finished_products", static_cast<double>(total) });
+        addProductKpis(kpis, std::make_integer_sequence<int, productCount>());
+        for (int pool = 0; pool < poolCount; pool++) {
+            kpis.push_back({ std::string("usage_time.") + Line::poolNames[pool], usageTime[pool] });
+        }
+        addStageKpis(kpis, "waiting_time.", false, std::make_integer_sequence<int, stageCount>());
+        addStageKpis(kpis, "queue_at_end.", true, std::make_integer_sequence<int, stageCount>());
+        kpis.push_back({ "tardy_products", static_cast<double>(tardyProducts) });
+        kpis.push_back({ "total_tardiness", totalTardiness });
+        return kpis;
+    }
+};
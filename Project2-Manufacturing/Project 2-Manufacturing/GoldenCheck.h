@@ -0,0 +1,174 @@
+﻿#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "ResultsWriter.h"
+
+// Golden-output regression check: KPI vectors of a fixed catalogue of seeded runs are stored
+// once and every later build is compared against them. The events_per_second KPI is timing,
+// not output; it is reported as a speed change and never counts as drift.
+typedef std::vector<std::pair<std::string, KpiVector>> GoldenCases;
+
+const char* const goldenSpeedKpi = "events_per_second";
+
+// Allowed difference per KPI, relative to the golden value (absolute below 1).
+// Rules are KPI name prefixes; the longest matching one wins.
+class KpiTolerances {
+private:
+    double defaultTolerance = 1e-9;
+    std::vector<std::pair<std::string, double>> rules;
+
+public:
+    // "<value>" sets the default, "<kpi prefix>=<value>" adds a rule
+    bool parse(const std::string& spec) {
+        size_t equals = spec.find('=');
+        char* end = nullptr;
+        std::string number = equals == std::string::npos ? spec : spec.substr(equals + 1);
+        double value = std::strtod(number.c_str(), &end);
+        if (number.empty() || *end != '\0' || value < 0.0) {
+            std::cout << "Invalid tolerance " << spec << std::endl;
+            return false;
+        }
+        if (equals == std::string::npos) {
+            defaultTolerance = value;
+        }
+        else {
+            rules.push_back({ spec.substr(0, equals), value });
+        }
+        return true;
+    }
+
+    double forKpi(const std::string& kpi) const {
+        double tolerance = defaultTolerance;
+        size_t longest = 0;
+        for (const auto& rule : rules) {
+            if (kpi.compare(0, rule.first.size(), rule.first) == 0 && rule.first.size() >= longest) {
+                tolerance = rule.second;
+                longest = rule.first.size();
+            }
+        }
+        return tolerance;
+    }
+};
+
+inline bool writeGoldenFile(const std::string& filename, const GoldenCases& cases) {
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        std::cout << "Could not open golden file " << filename << std::endl;
+        return false;
+    }
+    std::string buffer = "case,kpi,value\n";
+    char number[32];
+    for (const auto& entry : cases) {
+        for (const auto& kpi : entry.second) {
+            std::snprintf(number, sizeof(number), ",%.17g\n", kpi.second);
+            buffer += entry.first + "," + kpi.first + number;
+        }
+    }
+    file << buffer;
+    return true;
+}
+
+inline bool readGoldenFile(const std::string& filename, GoldenCases& cases) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cout << "Could not open golden file " << filename << std::endl;
+        return false;
+    }
+    cases.clear();
+    std::string line;
+    std::getline(file, line); // header
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        size_t first = line.find(',');
+        size_t second = line.find(',', first + 1);
+        if (first == std::string::npos || second == std::string::npos) {
+            continue;
+        }
+        std::string name = line.substr(0, first);
+        if (cases.empty() || cases.back().first != name) {
+            cases.push_back({ name, KpiVector() });
+        }
+        cases.back().second.push_back({ line.substr(first + 1, second - first - 1), std::strtod(line.c_str() + second + 1, nullptr) });
+    }
+    return true;
+}
+
+// Prints every KPI outside its tolerance, missing or new, plus the speed change per case.
+// Returns the number of drifted values.
+inline int compareGolden(const GoldenCases& golden, const GoldenCases& current, const KpiTolerances& tolerances, std::ostream& out) {
+    int drift = 0;
+    double goldenSeconds = 0.0;
+    double currentSeconds = 0.0;
+    std::map<std::string, const KpiVector*> currentByName;
+    for (const auto& entry : current) {
+        currentByName[entry.first] = &entry.second;
+    }
+    for (const auto& entry : golden) {
+        auto found = currentByName.find(entry.first);
+        if (found == currentByName.end()) {
+            out << entry.first << ": case missing from this build\n";
+            drift++;
+            continue;
+        }
+        std::map<std::string, double> values(found->second->begin(), found->second->end());
+        currentByName.erase(found);
+        double goldenSpeed = 0.0;
+        double currentSpeed = 0.0;
+        double events = 0.0;
+        for (const auto& kpi : entry.second) {
+            auto value = values.find(kpi.first);
+            if (kpi.first == goldenSpeedKpi) {
+                goldenSpeed = kpi.second;
+                currentSpeed = value != values.end() ? value->second : 0.0;
+            }
+            else if (value == values.end()) {
+                out << entry.first << ": " << kpi.first << " missing\n";
+                drift++;
+            }
+            else if (std::fabs(value->second - kpi.second) > tolerances.forKpi(kpi.first) * std::max(1.0, std::fabs(kpi.second))) {
+                char line[256];
+                std::snprintf(line, sizeof(line), "%s: %s changed from %.17g to %.17g\n", entry.first.c_str(), kpi.first.c_str(), kpi.second, value->second);
+                out << line;
+                drift++;
+            }
+            if (kpi.first == "events_processed") {
+                events = kpi.second;
+            }
+            if (value != values.end()) {
+                values.erase(value);
+            }
+        }
+        for (const auto& extra : values) {
+            out << entry.first << ": new KPI " << extra.first << "\n";
+            drift++;
+        }
+        if (goldenSpeed > 0.0 && currentSpeed > 0.0) {
+            char line[256];
+            std::snprintf(line, sizeof(line), "%s: %.0f events/s (golden %.0f, %+.1f %%)\n", entry.first.c_str(), currentSpeed, goldenSpeed, (currentSpeed / goldenSpeed - 1.0) * 100.0);
+            out << line;
+            goldenSeconds += events / goldenSpeed;
+            currentSeconds += events / currentSpeed;
+        }
+    }
+    for (const auto& extra : currentByName) {
+        out << extra.first << ": new case, not in the golden file\n";
+        drift++;
+    }
+    if (goldenSeconds > 0.0 && currentSeconds > 0.0) {
+        char line[128];
+        std::snprintf(line, sizeof(line), "Catalogue speed: %+.1f %% against golden\n", (goldenSeconds / currentSeconds - 1.0) * 100.0);
+        out << line;
+    }
+    out << (drift == 0 ? "No KPI drift\n" : std::to_string(drift) + " KPI values drifted\n");
+    return drift;
+}
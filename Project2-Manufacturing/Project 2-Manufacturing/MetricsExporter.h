@@ -0,0 +1,169 @@
+﻿#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#include "Sockets.h"
+
+// Counters published by the simulation thread. There is a single writer, so it only does
+// relaxed loads and stores; the exporter thread reads them without ever blocking the run.
+struct LiveMetrics {
+    std::atomic<long long> events{ 0 };
+    std::atomic<double> simulatedTime{ 0.0 };
+    std::atomic<long long> eventQueueDepth{ 0 };
+    std::atomic<long long> finishedProducts{ 0 };
+    std::atomic<long long> workInProcess{ 0 };
+    std::atomic<long long> tardyProducts{ 0 };
+    std::atomic<long long> runsCompleted{ 0 };
+    std::atomic<const std::string*> scenario{ nullptr };
+
+    // One label per scenario, kept for the life of the process so a reader never sees a freed
+    // string; replications of a scenario reuse its label
+    void beginRun(const std::string& name) {
+        {
+            std::lock_guard<std::mutex> lock(labelMutex);
+            scenario.store(&*labels.insert(name).first, std::memory_order_release);
+        }
+        simulatedTime.store(0.0, std::memory_order_relaxed);
+        eventQueueDepth.store(0, std::memory_order_relaxed);
+        finishedProducts.store(0, std::memory_order_relaxed);
+        workInProcess.store(0, std::memory_order_relaxed);
+        tardyProducts.store(0, std::memory_order_relaxed);
+    }
+
+    void endRun() {
+        runsCompleted.store(runsCompleted.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+private:
+    std::mutex labelMutex; // only taken once per run, never per event
+    std::set<std::string> labels;
+};
+
+// Serves LiveMetrics in the Prometheus text format on http://127.0.0.1:<port>/metrics
+class MetricsExporter {
+private:
+    LiveMetrics& metrics;
+    std::thread server;
+    std::atomic<bool> running{ false };
+    SocketHandle listener = INVALID_SOCKET;
+    // Event rate over the last second, sampled by the server thread itself so that it does not
+    // depend on how many scrapers there are or how often they come
+    long long sampledEvents = 0;
+    std::chrono::steady_clock::time_point sampledAt = std::chrono::steady_clock::now();
+    double eventsPerSecond = 0.0;
+
+    void sampleRate() {
+        auto now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - sampledAt).count();
+        if (seconds >= 1.0) {
+            long long events = metrics.events.load(std::memory_order_relaxed);
+            eventsPerSecond = (events - sampledEvents) / seconds;
+            sampledEvents = events;
+            sampledAt = now;
+        }
+    }
+
+    std::string render() const {
+        long long events = metrics.events.load(std::memory_order_relaxed);
+        const std::string* scenario = metrics.scenario.load(std::memory_order_acquire);
+        std::string label = "{scenario=\"" + (scenario != nullptr ? *scenario : std::string()) + "\"}";
+        std::string body;
+        char line[256];
+        auto gauge = [&](const char* name, const char* type, const char* help, double value) {
+            std::snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n%s%s %.10g\n", name, help, name, type, name, label.c_str(), value);
+            body += line;
+        };
+        gauge("manufacturing_events_total", "counter", "Events processed by the simulation kernel.", static_cast<double>(events));
+        gauge("manufacturing_events_per_second", "gauge", "Events processed per wall-clock second over the last second.", eventsPerSecond);
+        gauge("manufacturing_simulated_time_hours", "gauge", "Simulation clock of the current run.", metrics.simulatedTime.load(std::memory_order_relaxed));
+        gauge("manufacturing_event_queue_depth", "gauge", "Pending events in the event queue.", static_cast<double>(metrics.eventQueueDepth.load(std::memory_order_relaxed)));
+        gauge("manufacturing_finished_products", "gauge", "Products finished in the current run.", static_cast<double>(metrics.finishedProducts.load(std::memory_order_relaxed)));
+        gauge("manufacturing_work_in_process", "gauge", "Products released and not yet finished.", static_cast<double>(metrics.workInProcess.load(std::memory_order_relaxed)));
+        gauge("manufacturing_tardy_products", "gauge", "Products finished after their due date in the current run.", static_cast<double>(metrics.tardyProducts.load(std::memory_order_relaxed)));
+        gauge("manufacturing_runs_completed_total", "counter", "Simulation runs finished by this process.", static_cast<double>(metrics.runsCompleted.load(std::memory_order_relaxed)));
+        return body;
+    }
+
+    void serve() {
+        while (running.load()) {
+            sampleRate();
+            fd_set readable;
+            FD_ZERO(&readable);
+            FD_SET(listener, &readable);
+            timeval timeout = { 0, 200000 };
+            if (select(static_cast<int>(listener) + 1, &readable, nullptr, nullptr, &timeout) <= 0) {
+                continue;
+            }
+            SocketHandle client = accept(listener, nullptr, nullptr);
+            if (client == INVALID_SOCKET) {
+                continue;
+            }
+            // A client that connects and stays silent is dropped, so it can never hold up stop()
+            fd_set request;
+            FD_ZERO(&request);
+            FD_SET(client, &request);
+            timeval requestTimeout = { 1, 0 };
+            char buffer[1024];
+            if (select(static_cast<int>(client) + 1, &request, nullptr, nullptr, &requestTimeout) > 0
+                && recv(client, buffer, sizeof(buffer), 0) > 0) {
+                std::string body = render();
+                sendAll(client, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+                    + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body);
+            }
+            CLOSE_SOCKET(client);
+        }
+    }
+
+public:
+    explicit MetricsExporter(LiveMetrics& liveMetrics)
+        : metrics(liveMetrics) {
+    }
+
+    ~MetricsExporter() {
+        stop();
+    }
+
+    bool start(int port) {
+        if (!startSockets()) {
+            return false;
+        }
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        if (listener == INVALID_SOCKET) {
+            return false;
+        }
+        int reuse = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<unsigned short>(port));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 4) != 0) {
+            std::cout << "Could not serve metrics on port " << port << std::endl;
+            CLOSE_SOCKET(listener);
+            listener = INVALID_SOCKET;
+            stopSockets();
+            return false;
+        }
+        running = true;
+        server = std::thread([this] { serve(); });
+        std::cout << "Serving metrics on http://127.0.0.1:" << port << "/metrics" << std::endl;
+        return true;
+    }
+
+    void stop() {
+        if (running.exchange(false)) {
+            server.join();
+        }
+        if (listener != INVALID_SOCKET) {
+            CLOSE_SOCKET(listener);
+            listener = INVALID_SOCKET;
+            stopSockets();
+        }
+    }
+};
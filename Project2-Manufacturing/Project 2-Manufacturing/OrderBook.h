@@ -0,0 +1,238 @@
+﻿#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+#include "MappedFile.h"
+
+struct Order {
+    std::string id;
+    std::string productType;
+    int quantity;
+    double releaseDate;
+    double dueDate;
+    double weight = 0.0; // 0 when the order book gives none, so the product's weight applies
+};
+
+enum class ReleasePolicy { Immediate, CONWIP, WorkloadControl };
+
+// Lateness statistics accumulated one completed order at a time. Orders closed short, with units
+// scrapped, were never delivered in full: they have no lateness and count as missed.
+struct DueDateStats {
+    long long count = 0;
+    long long shortCount = 0;
+    long long onTime = 0;
+    double totalTardiness = 0.0;
+    double totalEarliness = 0.0;
+    double maxTardiness = 0.0;
+    double meanLateness = 0.0;
+    double latenessM2 = 0.0; // Welford sum of squared deviations
+
+    void add(double completionTime, double dueDate) {
+        double lateness = completionTime - dueDate;
+        count++;
+        if (lateness <= 0.0) {
+            onTime++;
+            totalEarliness -= lateness;
+        }
+        else {
+            totalTardiness += lateness;
+            maxTardiness = std::max(maxTardiness, lateness);
+        }
+        double delta = lateness - meanLateness;
+        meanLateness += delta / count;
+        latenessM2 += delta * (lateness - meanLateness);
+    }
+
+    void addShort() {
+        shortCount++;
+    }
+
+    double serviceLevel() const {
+        return count + shortCount > 0 ? static_cast<double>(onTime) / (count + shortCount) : 0.0;
+    }
+
+    double latenessStdDev() const {
+        return count > 1 ? std::sqrt(latenessM2 / (count - 1)) : 0.0;
+    }
+};
+
+// Parses a number that fills [begin, end) exactly. The field is copied to a small stack buffer
+// because a mapped file is not null-terminated.
+inline bool parseOrderNumber(const char* begin, const char* end, double& value) {
+    char buffer[64];
+    size_t length = static_cast<size_t>(end - begin);
+    if (length == 0 || length >= sizeof(buffer)) {
+        return false;
+    }
+    std::memcpy(buffer, begin, length);
+    buffer[length] = '\0';
+    char* parsedEnd;
+    value = std::strtod(buffer, &parsedEnd);
+    return parsedEnd == buffer + length;
+}
+
+// Same for a whole number such as a quantity, so "2.5" is rejected rather than truncated
+inline bool parseOrderNumber(const char* begin, const char* end, int& value) {
+    char buffer[32];
+    size_t length = static_cast<size_t>(end - begin);
+    if (length == 0 || length >= sizeof(buffer)) {
+        return false;
+    }
+    std::memcpy(buffer, begin, length);
+    buffer[length] = '\0';
+    char* parsedEnd;
+    long parsed = std::strtol(buffer, &parsedEnd, 10);
+    if (parsedEnd != buffer + length || parsed < std::numeric_limits<int>::min() || parsed > std::numeric_limits<int>::max()) {
+        return false;
+    }
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+// Parses "order_id,product_type,quantity,release_date,due_date[,weight]" lines starting at `cursor`.
+// Returns false at the end of the buffer; malformed lines are reported and skipped.
+inline bool parseOrderLine(const char*& cursor, const char* end, Order& order, long long& lineNumber) {
+    while (cursor < end) {
+        const char* lineEnd = std::find(cursor, end, '\n');
+        const char* fields[6];
+        const char* fieldEnds[6];
+        int fieldCount = 0;
+        const char* field = cursor;
+        for (const char* c = cursor; c <= lineEnd && fieldCount < 6; c++) {
+            if (c == lineEnd || *c == ',') {
+                fields[fieldCount] = field;
+                fieldEnds[fieldCount] = (c > field && c[-1] == '\r') ? c - 1 : c;
+                fieldCount++;
+                field = c + 1;
+            }
+        }
+        cursor = lineEnd < end ? lineEnd + 1 : end;
+        lineNumber++;
+        if (fieldCount == 1 && fieldEnds[0] == fields[0]) {
+            continue; // blank line
+        }
+        order.weight = 0.0;
+        if ((fieldCount == 5 || fieldCount == 6)
+            && parseOrderNumber(fields[2], fieldEnds[2], order.quantity) && order.quantity >= 1
+            && parseOrderNumber(fields[3], fieldEnds[3], order.releaseDate)
+            && parseOrderNumber(fields[4], fieldEnds[4], order.dueDate)
+            && (fieldCount == 5 || (parseOrderNumber(fields[5], fieldEnds[5], order.weight) && order.weight > 0.0))) {
+            order.id.assign(fields[0], fieldEnds[0]);
+            order.productType.assign(fields[1], fieldEnds[1]);
+            return true;
+        }
+        if (lineNumber > 1) { // the first line may be the column header
+            std::cout << "Skipping malformed order line " << lineNumber << std::endl;
+        }
+    }
+    return false;
+}
+
+// Pulls orders lazily from a memory-mapped order book, or from one held in memory. A small min-heap of upcoming orders
+// reorders lines that are slightly out of chronological order; anything older than an order
+// already handed out is released as soon as it is read and counted in lateOrders().
+class OrderStream {
+private:
+    struct Pending {
+        Order order;
+        long long sequence;
+    };
+    MappedFile file;
+    std::string text; // order book given as a string instead of a file
+    bool fromText = false;
+    const char* bufferBegin = nullptr;
+    const char* bufferEnd = nullptr;
+    const char* cursor = nullptr;
+    long long lineNumber = 0;
+    long long sequence = 0;
+    long long outOfOrder = 0;
+    double lastReleaseDate = 0.0;
+    size_t windowSize = 256;
+    std::vector<Pending> window;
+
+    static bool later(const Pending& a, const Pending& b) {
+        return a.order.releaseDate > b.order.releaseDate
+            || (a.order.releaseDate == b.order.releaseDate && a.sequence > b.sequence);
+    }
+
+    void fill() {
+        Pending pending;
+        while (window.size() < windowSize && parseOrderLine(cursor, bufferEnd, pending.order, lineNumber)) {
+            pending.sequence = sequence++;
+            window.push_back(std::move(pending));
+            std::push_heap(window.begin(), window.end(), later);
+        }
+    }
+
+public:
+    bool open(const std::string& filename, size_t lookahead = 256) {
+        if (!file.open(filename)) {
+            std::cout << "Could not open order book " << filename << std::endl;
+            return false;
+        }
+        text.clear();
+        fromText = false;
+        bufferBegin = file.begin();
+        bufferEnd = file.end();
+        windowSize = lookahead > 0 ? lookahead : 1;
+        rewind();
+        return true;
+    }
+
+    // Same CSV format as open(), for order books generated by the program itself
+    void openText(const std::string& csv, size_t lookahead = 256) {
+        file.close();
+        text = csv;
+        fromText = true;
+        bufferBegin = text.data();
+        bufferEnd = text.data() + text.size();
+        windowSize = lookahead > 0 ? lookahead : 1;
+        rewind();
+    }
+
+    bool isOpen() const {
+        return fromText || file.isOpen();
+    }
+
+    void rewind() {
+        cursor = bufferBegin;
+        lineNumber = 0;
+        sequence = 0;
+        outOfOrder = 0;
+        lastReleaseDate = 0.0;
+        window.clear();
+        window.reserve(windowSize);
+        fill();
+    }
+
+    bool empty() const {
+        return window.empty();
+    }
+
+    // Release date of the next order, never earlier than the last one handed out
+    double nextReleaseDate() const {
+        return std::max(window.front().order.releaseDate, lastReleaseDate);
+    }
+
+    Order pop() {
+        std::pop_heap(window.begin(), window.end(), later);
+        Order order = std::move(window.back().order);
+        window.pop_back();
+        if (order.releaseDate < lastReleaseDate) {
+            outOfOrder++;
+        }
+        lastReleaseDate = std::max(lastReleaseDate, order.releaseDate);
+        fill();
+        return order;
+    }
+
+    long long lateOrders() const {
+        return outOfOrder;
+    }
+};
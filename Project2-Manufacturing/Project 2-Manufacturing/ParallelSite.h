@@ -0,0 +1,448 @@
+﻿#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Reusable barrier for a fixed set of threads (std::barrier needs C++20)
+class ThreadBarrier {
+private:
+    std::mutex mutex;
+    std::condition_variable released;
+    int threads;
+    int waiting = 0;
+    long long generation = 0;
+
+public:
+    explicit ThreadBarrier(int count)
+        : threads(count) {
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        long long arrived = generation;
+        if (++waiting == threads) {
+            waiting = 0;
+            generation++;
+            released.notify_all();
+            return;
+        }
+        released.wait(lock, [&] { return generation != arrived; });
+    }
+};
+
+struct SiteStats {
+    long long windows = 0; // synchronisation rounds: windows, or GVT rounds when optimistic
+    long long transfers = 0;
+    long long rollbacks = 0;
+    long long undoneBatches = 0; // batches executed speculatively and rolled back
+    long long antiMessages = 0;
+};
+
+// Key of the `sent`-th product an area has sent on, unique across the site
+inline long long transferOrigin(int area, long long sent) {
+    return (static_cast<long long>(area + 1) << 32) + sent;
+}
+
+// Plant areas run as logical processes under a conservative, YAWNS-style window protocol.
+// Before each window every area reports the earliest time a product it sends on could
+// arrive anywhere (its lookahead bound). All areas then run in parallel up to the smallest
+// bound, where nothing can reach them from the past any more, and the transfers sent in
+// the window are delivered at the barrier, in area order, so runs do not depend on the
+// thread count. Area provides
+//   startRun(runTime), nextEventTime(), exitBound(), advanceTo(limit), finishRun(),
+//   takeTransfers(std::vector<Transfer>&) and receiveTransfer(const Transfer&);
+// Transfer has time and origin, the area's own count of products it has sent.
+template <typename Area, typename Transfer>
+class ConservativeSite {
+private:
+    std::vector<Area*> areas;
+    std::vector<int> targets; // area receiving each area's output, -1 if it ships finished goods
+
+public:
+    int addArea(Area& area) {
+        areas.push_back(&area);
+        targets.push_back(-1);
+        return static_cast<int>(areas.size()) - 1;
+    }
+
+    void connect(int from, int to) {
+        targets[from] = to;
+    }
+
+    SiteStats run(double runTime, int threads) {
+        SiteStats stats;
+        const double never = std::numeric_limits<double>::infinity();
+        int areaCount = static_cast<int>(areas.size());
+        threads = std::max(1, std::min(threads, areaCount));
+        for (Area* area : areas) {
+            area->startRun(runTime);
+        }
+
+        double windowEnd = 0.0;
+        bool finished = false;
+        ThreadBarrier barrier(threads);
+        auto advance = [&](int worker) {
+            for (int area = worker; area < areaCount; area += threads) {
+                areas[area]->advanceTo(windowEnd);
+            }
+        };
+        std::vector<std::thread> workers;
+        for (int worker = 1; worker < threads; worker++) {
+            workers.emplace_back([&, worker] {
+                for (;;) {
+                    barrier.wait(); // window published
+                    if (finished) {
+                        return;
+                    }
+                    advance(worker);
+                    barrier.wait(); // window done
+                }
+            });
+        }
+
+        std::vector<Transfer> mailbox;
+        for (;;) {
+            double earliest = never;
+            double bound = never;
+            for (Area* area : areas) {
+                earliest = std::min(earliest, area->nextEventTime());
+                bound = std::min(bound, area->exitBound());
+            }
+            if (earliest >= runTime) {
+                break;
+            }
+            windowEnd = std::min(bound, runTime);
+            if (windowEnd <= earliest) {
+                std::cout << "Site stalled at time " << earliest << ": lookahead must be positive" << std::endl;
+                break;
+            }
+            stats.windows++;
+            barrier.wait();
+            advance(0);
+            barrier.wait();
+            for (int area = 0; area < areaCount; area++) {
+                mailbox.clear();
+                areas[area]->takeTransfers(mailbox);
+                for (Transfer& transfer : mailbox) {
+                    transfer.origin = transferOrigin(area, transfer.origin);
+                    areas[targets[area]]->receiveTransfer(transfer);
+                }
+                stats.transfers += static_cast<long long>(mailbox.size());
+            }
+        }
+        finished = true;
+        barrier.wait();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        for (Area* area : areas) {
+            area->finishRun();
+        }
+        return stats;
+    }
+};
+
+// Plant areas run as Time Warp logical processes: every area executes its events as soon as it
+// has them, without waiting for the areas upstream, and rolls back when a product arrives in its
+// past (a straggler). Area state is copied into a checkpoint every few batches; a rollback
+// restores the latest checkpoint before the straggler and coasts forward from there, re-executing
+// the batches before the straggler without sending their products again. Products sent at or
+// after the straggler time are cancelled with anti-messages. Rounds end at a barrier where
+// global virtual time (GVT, the earliest time any area can still be rolled back to) is
+// computed; checkpoints, inputs and sent records no rollback can reach any more are fossil
+// collected, and areas may not run further than the optimism window ahead of GVT. Committed
+// results equal a sequential run, whatever the thread count. On top of the ConservativeSite
+// interface, Area provides processBatch(), canCheckpoint(), a Checkpoint type,
+// saveCheckpoint(Checkpoint&) and restoreCheckpoint(const Checkpoint&).
+template <typename Area, typename Transfer>
+class OptimisticSite {
+private:
+    struct Message {
+        Transfer transfer;
+        bool anti;
+    };
+
+    struct Saved {
+        double time; // every batch up to this time is in the state
+        long long batches;
+        typename Area::Checkpoint state;
+    };
+
+    struct SentTransfer {
+        double time; // local time of the batch that sent it
+        Transfer transfer;
+    };
+
+    struct Process {
+        Area* area = nullptr;
+        int target = -1; // area receiving this area's output, -1 if it ships finished goods
+        std::mutex inboxMutex;
+        std::vector<Message> inbox; // filled by other threads, drained by the owner
+        std::vector<Message> arrived;
+        std::vector<Transfer> inputs; // by (time, origin); inputs before nextInput are executed
+        size_t nextInput = 0;
+        std::deque<Saved> saved;
+        std::vector<Saved> spare; // fossil checkpoints kept for their buffers
+        std::deque<SentTransfer> sent;
+        std::vector<Transfer> outbox;
+        double localTime = -std::numeric_limits<double>::infinity();
+        double coastUntil = -std::numeric_limits<double>::infinity(); // batches before it were sent already
+        long long batches = 0;
+        int sinceCheckpoint = 0;
+        SiteStats stats;
+    };
+
+    std::deque<Process> processes;
+    double window = 8.0;
+    int checkpointInterval = 8;
+
+    static bool before(const Transfer& a, const Transfer& b) {
+        return a.time < b.time || (a.time == b.time && a.origin < b.origin);
+    }
+
+    void save(Process& process) {
+        if (process.spare.empty()) {
+            process.saved.emplace_back();
+        }
+        else {
+            process.saved.push_back(std::move(process.spare.back()));
+            process.spare.pop_back();
+        }
+        Saved& saved = process.saved.back();
+        saved.time = process.localTime;
+        saved.batches = process.batches;
+        process.area->saveCheckpoint(saved.state);
+        process.sinceCheckpoint = 0;
+    }
+
+    void send(Process& from, const Transfer& transfer, bool anti) {
+        Process& to = processes[from.target];
+        std::lock_guard<std::mutex> lock(to.inboxMutex);
+        to.inbox.push_back({ transfer, anti });
+    }
+
+    // Cancels the products sent by batches at `time` or later; batches before it send the same
+    // products when they are executed again
+    void cancelSince(Process& process, double time) {
+        while (!process.sent.empty() && process.sent.back().time >= time) {
+            send(process, process.sent.back().transfer, true);
+            process.stats.antiMessages++;
+            process.stats.transfers--;
+            process.sent.pop_back();
+        }
+        process.coastUntil = time;
+    }
+
+    // Undoes every batch at `time` or later
+    void rollback(Process& process, double time) {
+        while (process.saved.back().time >= time) {
+            process.spare.push_back(std::move(process.saved.back()));
+            process.saved.pop_back();
+        }
+        const Saved& saved = process.saved.back();
+        process.area->restoreCheckpoint(saved.state);
+        process.stats.rollbacks++;
+        process.stats.undoneBatches += process.batches - saved.batches;
+        process.localTime = saved.time;
+        process.batches = saved.batches;
+        process.sinceCheckpoint = 0;
+        process.nextInput = 0;
+        while (process.nextInput < process.inputs.size() && process.inputs[process.nextInput].time <= saved.time) {
+            process.nextInput++;
+        }
+        cancelSince(process, time);
+    }
+
+    // A product arriving at or before the local time is a straggler; cancelling a product
+    // already executed needs a rollback as well. Any input change inside the stretch still to be
+    // coasted through makes the batches from there on differ from what was sent.
+    void receive(Process& process) {
+        {
+            std::lock_guard<std::mutex> lock(process.inboxMutex);
+            process.arrived.swap(process.inbox);
+        }
+        for (const Message& message : process.arrived) {
+            const Transfer& transfer = message.transfer;
+            auto position = std::lower_bound(process.inputs.begin(), process.inputs.end(), transfer, before);
+            size_t index = static_cast<size_t>(position - process.inputs.begin());
+            if (transfer.time <= process.localTime) {
+                rollback(process, transfer.time);
+            }
+            if (transfer.time < process.coastUntil) {
+                cancelSince(process, transfer.time);
+            }
+            if (message.anti) {
+                process.inputs.erase(process.inputs.begin() + index);
+            }
+            else {
+                process.inputs.insert(process.inputs.begin() + index, transfer);
+            }
+        }
+        process.arrived.clear();
+    }
+
+    // Executes the next batch if it lies before the run end and inside the optimism window
+    bool step(int index, double limit) {
+        Process& process = processes[index];
+        double next = process.area->nextEventTime();
+        if (process.nextInput < process.inputs.size()) {
+            next = std::min(next, process.inputs[process.nextInput].time);
+        }
+        if (next >= limit) {
+            return false;
+        }
+        while (process.nextInput < process.inputs.size() && process.inputs[process.nextInput].time <= next) {
+            process.area->receiveTransfer(process.inputs[process.nextInput++]);
+        }
+        process.area->processBatch();
+        process.localTime = next;
+        process.batches++;
+        process.outbox.clear();
+        process.area->takeTransfers(process.outbox);
+        if (next < process.coastUntil) {
+            process.outbox.clear();
+        }
+        for (Transfer& transfer : process.outbox) {
+            transfer.origin = transferOrigin(index, transfer.origin);
+            process.sent.push_back({ next, transfer });
+            send(process, transfer, false);
+            process.stats.transfers++;
+        }
+        if (++process.sinceCheckpoint == checkpointInterval) {
+            save(process);
+        }
+        return true;
+    }
+
+    // Earliest time this area can still execute or be rolled back to; only valid while every
+    // worker waits at the barrier
+    double earliestTime(Process& process) const {
+        double earliest = process.area->nextEventTime();
+        if (process.nextInput < process.inputs.size()) {
+            earliest = std::min(earliest, process.inputs[process.nextInput].time);
+        }
+        for (const Message& message : process.inbox) {
+            earliest = std::min(earliest, message.transfer.time);
+        }
+        return earliest;
+    }
+
+    // Drops what no rollback can reach once every area is past `gvt`: all checkpoints before
+    // the last one taken before it, the inputs older than that one and the sent records before
+    // `gvt`, which a rollback never cancels
+    void collectFossils(Process& process, double gvt) {
+        while (process.saved.size() > 1 && process.saved[1].time < gvt) {
+            process.spare.push_back(std::move(process.saved.front()));
+            process.saved.pop_front();
+        }
+        double oldest = process.saved.front().time;
+        size_t fossils = 0;
+        while (fossils < process.nextInput && process.inputs[fossils].time <= oldest) {
+            fossils++;
+        }
+        process.inputs.erase(process.inputs.begin(), process.inputs.begin() + fossils);
+        process.nextInput -= fossils;
+        while (!process.sent.empty() && process.sent.front().time < gvt) {
+            process.sent.pop_front();
+        }
+    }
+
+public:
+    int addArea(Area& area) {
+        processes.emplace_back();
+        processes.back().area = &area;
+        return static_cast<int>(processes.size()) - 1;
+    }
+
+    void connect(int from, int to) {
+        processes[from].target = to;
+    }
+
+    // How far (in simulated hours) areas may run ahead of GVT, and batches between checkpoints
+    void setOptimism(double hours, int batchesPerCheckpoint) {
+        window = hours;
+        checkpointInterval = std::max(batchesPerCheckpoint, 1);
+    }
+
+    SiteStats run(double runTime, int threads) {
+        SiteStats stats;
+        int processCount = static_cast<int>(processes.size());
+        threads = std::max(1, std::min(threads, processCount));
+        for (Process& process : processes) {
+            if (!process.area->canCheckpoint()) {
+                std::cout << "Optimistic site areas cannot use order books, KPI sampling or live metrics" << std::endl;
+                return stats;
+            }
+        }
+        for (Process& process : processes) {
+            process.area->startRun(runTime);
+            save(process); // the state before the first batch, never fossil collected before it is replaced
+        }
+
+        double gvt = -std::numeric_limits<double>::infinity();
+        bool finished = false;
+        ThreadBarrier barrier(threads);
+        // Each worker runs its areas until none of them can go further inside the window
+        auto optimistic = [&](int worker) {
+            double limit = std::min(runTime, gvt + window);
+            bool progress = true;
+            while (progress) {
+                progress = false;
+                for (int index = worker; index < processCount; index += threads) {
+                    receive(processes[index]);
+                    while (step(index, limit)) {
+                        progress = true;
+                    }
+                }
+            }
+        };
+        std::vector<std::thread> workers;
+        for (int worker = 1; worker < threads; worker++) {
+            workers.emplace_back([&, worker] {
+                for (;;) {
+                    barrier.wait(); // GVT published
+                    if (finished) {
+                        return;
+                    }
+                    optimistic(worker);
+                    barrier.wait(); // round done
+                }
+            });
+        }
+
+        for (;;) {
+            gvt = std::numeric_limits<double>::infinity();
+            for (Process& process : processes) {
+                gvt = std::min(gvt, earliestTime(process));
+            }
+            if (gvt >= runTime) {
+                break;
+            }
+            for (Process& process : processes) {
+                collectFossils(process, gvt);
+            }
+            stats.windows++;
+            barrier.wait();
+            optimistic(0);
+            barrier.wait();
+        }
+        finished = true;
+        barrier.wait();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        for (Process& process : processes) {
+            stats.transfers += process.stats.transfers;
+            stats.rollbacks += process.stats.rollbacks;
+            stats.undoneBatches += process.stats.undoneBatches;
+            stats.antiMessages += process.stats.antiMessages;
+            process.area->finishRun();
+        }
+        return stats;
+    }
+};
@@ -0,0 +1,87 @@
+﻿#pragma once
+#include <cstddef>
+#include <ostream>
+
+// Built-in hot-path profile, compiled in only with MANUFACTURING_PROFILE defined
+// (C/C++ > Preprocessor in the project settings, or -DMANUFACTURING_PROFILE).
+// Without it PROFILE_SCOPE expands to nothing and no counters are touched.
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+inline unsigned long long readTicks() {
+    return __rdtsc();
+}
+#define PROFILE_TICK_UNIT "cycles"
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+inline unsigned long long readTicks() {
+    return __rdtsc();
+}
+#define PROFILE_TICK_UNIT "cycles"
+#else
+#include <chrono>
+inline unsigned long long readTicks() {
+    return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+#define PROFILE_TICK_UNIT "ns"
+#endif
+
+// Call counts and inclusive ticks per section, plus the event queue high-water mark
+template <int Sections>
+struct Profiler {
+    static const int sectionCount = Sections;
+    long long calls[Sections] = {};
+    unsigned long long ticks[Sections] = {};
+    size_t queueHighWater = 0;
+
+    void reset() {
+        for (int i = 0; i < Sections; i++) {
+            calls[i] = 0;
+            ticks[i] = 0;
+        }
+        queueHighWater = 0;
+    }
+
+    void noteQueueSize(size_t size) {
+        if (size > queueHighWater) {
+            queueHighWater = size;
+        }
+    }
+
+    void report(std::ostream& out, const char* const names[Sections]) const {
+        for (int i = 0; i < Sections; i++) {
+            if (calls[i] == 0) {
+                continue;
+            }
+            out << names[i] << ": " << calls[i] << " calls, " << ticks[i] << " " PROFILE_TICK_UNIT ", "
+                << ticks[i] / calls[i] << " per call\n";
+        }
+        out << "Event queue high-water mark: " << queueHighWater << " events\n";
+    }
+};
+
+template <int Sections>
+class ProfileScope {
+private:
+    Profiler<Sections>& profiler;
+    int section;
+    unsigned long long start;
+
+public:
+    ProfileScope(Profiler<Sections>& owner, int index)
+        : profiler(owner), section(index), start(readTicks()) {
+    }
+
+    ~ProfileScope() {
+        profiler.calls[section]++;
+        profiler.ticks[section] += readTicks() - start;
+    }
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#ifdef MANUFACTURING_PROFILE
+#define PROFILE_SCOPE(profiler, section) ProfileScope<decltype(profiler)::sectionCount> PROFILE_CONCAT(profileScope, __LINE__)(profiler, section)
+#else
+#define PROFILE_SCOPE(profiler, section) ((void)0)
+#endif
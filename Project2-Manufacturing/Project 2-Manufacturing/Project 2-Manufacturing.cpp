@@ -1,147 +1,1078 @@
-﻿#include <iostream>
+﻿// Contraction of a * b + c into one fused multiply-add rounds once instead of twice, so results
+// would differ between targets with and without FMA (GCC contracts by default where the target
+// has it, clang on arm64). It is off for the whole program, which keeps RandomStream and the
+// golden KPIs bit-reproducible; the same as building with -ffp-contract=off.
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#elif defined(_MSC_VER)
+#pragma fp_contract(off)
+#endif
+
+#include <algorithm>
+#include <iostream>
 #include <queue>
+#include <deque>
 #include <vector>
 #include <functional>
 #include <random>
-#include <ctime>
 #include <map>
+#include <memory>
+#include <memory_resource>
 #include <fstream>
 #include <string>
+#include <sstream>
+#include <numeric>
+#include <limits>
+#include <cstdlib>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "Bottleneck.h"
+#include "Calendar.h"
+#include "DispatchQueue.h"
+#include "FixedLine.h"
+#include "GoldenCheck.h"
+#include "MetricsExporter.h"
+#include "OrderBook.h"
+#include "ParallelSite.h"
+#include "Profiler.h"
+#include "Random.h"
+#include "RankingSelection.h"
+#include "ReplicationFarm.h"
+#include "ResourcePool.h"
+#include "ResultCache.h"
+#include "ResultsWriter.h"
+#include "SetupMatrix.h"
+#include "Station.h"
+#include "Surrogate.h"
+#include "TimeSeries.h"
+
+enum class EventKind { RawMaterialArrival, OrderRelease, Setup, StageCompletion, ShiftChange, Maintenance, KpiSample, TransferArrival, Count };
+
+// Profiled sections: one per event kind, plus handleNextStage which runs inside other events
+const int NextStageSection = static_cast<int>(EventKind::Count);
+typedef Profiler<NextStageSection + 1> EventProfiler;
+const char* const profileSectionNames[NextStageSection + 1] = {
+    "raw_material_arrival", "order_release", "setup", "stage_completion", "shift_change", "maintenance", "kpi_sample", "transfer_arrival", "handleNextStage"
+};
+
+// Order of events at the same time: capacity changes first, then completions, then new work,
+// and KPI samples last so they see the state after everything else at that instant
+inline int eventPriority(EventKind kind) {
+    switch (kind) {
+    case EventKind::ShiftChange: return 0;
+    case EventKind::Maintenance: return 0;
+    case EventKind::StageCompletion: return 1;
+    case EventKind::Setup: return 1;
+    case EventKind::OrderRelease: return 2;
+    case EventKind::RawMaterialArrival: return 2;
+    case EventKind::TransferArrival: return 2;
+    default: return 3;
+    }
+}
+
+struct Product {
+    std::string type;
+    int intermediateStage;
+    int id = 0;
+    int server = -1; // station server holding the product, -1 while it waits or uses a counted resource
+    double queuedSince = 0.0;
+    double dueDate = 0.0;
+    double weight = 1.0;
+    int order = -1; // slot of the open order, -1 for products from the raw material stream
+    int reworks = 0; // times sent back to an earlier stage
+};
 
-// Event structure to hold event time, type, and action
+// Event structure to hold event time, kind, and the product it is about. Events are plain
+// data dispatched on their kind, so the whole event queue can be copied with the system state.
+// Ties are broken by priority, then by origin and then by the order the events were scheduled in.
 struct Event {
     double time;
-    std::string type;
-    std::function<void()> action;
+    EventKind kind;
+    int priority;
+    long long origin; // 0 for events scheduled here, the sender's key for transfers from other areas
+    long long sequence;
+    Product product; // product type only for raw material arrivals, resource name for maintenance
 
     bool operator>(const Event& other) const {
-        return time > other.time;
+        if (time != other.time) {
+            return time > other.time;
+        }
+        if (priority != other.priority) {
+            return priority > other.priority;
+        }
+        if (origin != other.origin) {
+            return origin > other.origin;
+        }
+        return sequence > other.sequence;
     }
 };
 
-struct Product {
-    std::string type;
-    int intermediateStage;
+// A product handed from one plant area to the next, arriving there at `time`. The origin key
+// (sending area and its send count) orders simultaneous arrivals the same way however and
+// whenever the site delivers them.
+struct Transfer {
+    double time;
+    Product product;
+    long long origin;
 };
 
 class ManufacturingSystem {
 private:
-    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> eventQueue;
+    // Containers that grow and shrink while a run is going draw from a per-run arena: blocks
+    // they give back are recycled by the pool, and the arena is released in one go with the system
+    std::pmr::monotonic_buffer_resource arena{ 64 * 1024 };
+    std::pmr::unsynchronized_pool_resource memory{ &arena };
+
+    std::priority_queue<Event, std::pmr::vector<Event>, std::greater<Event>> eventQueue{ std::greater<Event>(), std::pmr::vector<Event>(&memory) };
+    long long eventSequence = 0;
+    bool inBatch = false; // stage starts are deferred to the end of the batch
     std::map<std::string, int> resources;
-    std::map<std::string, int> availableResources;
+    ResourcePools pools{ &memory }; // one pool per entry of resources
     std::map<std::string, double> resourceUsageTime;
     std::map<std::string, double> resourceWaitingTime;
     int rawMaterialCount = 0;
     int finishedProducts = 0;
+    int tardyProducts = 0;
+    double totalTardiness = 0.0;
+    double dueDateFactor = 3.0; // due date = arrival + factor * total processing time
+    bool trace = true; // print every event to the console
+
+    // Order-driven release; when an order book is loaded it replaces the raw material stream.
+    // Orders are read lazily and only open orders are kept, in slots reused once they complete.
+    OrderStream orderStream;
+    size_t orderWindow = 256;
+    std::pmr::vector<int> orderUnitsLeft{ &memory };
+    std::pmr::vector<double> orderDueDates{ &memory };
+    std::pmr::vector<int> orderUnitsScrapped{ &memory };
+    std::pmr::vector<int> freeOrderSlots{ &memory };
+    long long ordersReleased = 0;
+    long long ordersSkipped = 0;
+    ReleasePolicy releasePolicy = ReleasePolicy::Immediate;
+    int wipLimit = 50; // CONWIP: products allowed in the shop at once
+    double workloadNorm = 100.0; // workload control: released processing hours allowed in the shop
+    std::pmr::deque<Product> releasePool{ &memory }; // released orders waiting for the policy to let them in
+    int workInProcess = 0;
+    double releasedWorkload = 0.0;
+    DueDateStats orderStats;
+
+    // Periodic KPI snapshots; sampling is off while sampleInterval is 0
+    double sampleInterval = 0.0;
+    int sampleBucket = 1; // samples folded into one min/max/mean row
+    TimeSeriesRecorder timeSeries;
+    std::vector<double> sampleRow;
+    std::map<std::string, int> finishedAtLastSample;
     double currentTime = 0.0;
-    std::default_random_engine generator;
-    std::exponential_distribution<double> rawMaterialArrivalDist;
-    std::uniform_real_distribution<double> breakdownDist;
+    long long eventsProcessed = 0;
+    LiveMetrics* liveMetrics = nullptr; // published after every event when set
+    EventProfiler profiler; // only updated when built with MANUFACTURING_PROFILE
+    RandomStream random; // same numbers on every platform for the same seed
+    unsigned long long seed = 0;
+    double rawMaterialArrivalRate = 1.0;
     std::map<std::string, std::vector<double>> processingTimes;
-    std::map<std::string, int> productTypes;
+    std::map<std::string, int> productTypes; // product type -> index into the setup matrix
+    std::map<std::string, double> productWeights; // WSPT and ATC weight per product type, 1 if not listed
     std::map<std::string, int> finishedProductsPerType;
-    std::queue<Product> productQueue;
+
+    // Resources each stage holds while it runs, by name and resolved to pool indices
+    int stageCount = 4;
+    std::map<std::string, std::map<std::string, int>> stageRequirements;
+    std::vector<SeizeSet> stageSeizeSets;
+    std::vector<int> stageStations; // station providing individual servers to a stage, -1 if none
+    std::vector<DispatchQueue<Product>> stageQueues;
+    std::map<std::string, DispatchRule> stageDispatchRules; // stages not listed use FIFO
+    // Finite buffers in front of stages; stages not listed have room for every product. A product
+    // finishing the stage before a full buffer stays where it is until there is room (blocking
+    // after service) and waits in blockedProducts of the full stage, first come first served.
+    // It keeps its machine and the resources only its stage uses; units of pools other stages
+    // draw on too, such as operators, go back at once, so blocking cannot deadlock the line.
+    // A stage that keeps nothing still has its workplaces taken: it has one per unit of its pools
+    // at full strength, and starts no job while they are all in process or blocked.
+    std::map<std::string, int> bufferCapacities;
+    std::vector<int> stageBufferCapacity; // -1 for unlimited
+    std::vector<SeizeSet> heldWhileBlocked;
+    std::vector<SeizeSet> freedWhenBlocked;
+    std::vector<int> stageWorkplaces; // -1 where held resources bound the stage or nothing blocks it
+    std::vector<std::deque<Product>> blockedProducts;
+    std::vector<double> blockedTime; // per stage the product was blocked on
+
+    // Inspection outcomes: with the listed probabilities a product finishing a stage is scrapped
+    // or sent back to redo the route from an earlier stage, otherwise it passes on. Each stage's
+    // outcomes become a cumulative table once, so routing is one uniform draw and a binary
+    // search; stages without outcomes draw nothing, which keeps their random streams unchanged.
+    static constexpr int PassOutcome = -2;
+    static constexpr int ScrapOutcome = -1;
+    std::map<std::string, std::vector<std::pair<int, double>>> stageOutcomes; // (rework stage or ScrapOutcome, probability)
+    std::vector<std::vector<double>> outcomeCumulative;
+    std::vector<std::vector<int>> outcomeTargets;
+    std::vector<int> scrapCount; // per stage
+    std::vector<int> reworkCount;
+    int firstPassProducts = 0; // finished without rework
+    double atcLookahead = 2.0;
+    std::pmr::vector<int> wokenStages{ &memory };
+    int machinesPool = -1;
+    std::vector<int> stageInProcess; // jobs in setup or processing per stage
+    BottleneckDetector bottlenecks;
+    double bottleneckPeriod = 8.0; // length of the periods the bottleneck is reported for, e.g. a shift
 
     // New fields for shifts and setup times
     std::map<std::string, double> machineSetupTimes;
-    int shiftLength = 8; // 8-hour shifts
+    SetupMatrix setupMatrix;
+    StationModel stations{ &memory }; // individual machines, one station per machine-based stage
+    int machiningStation = -1;
+    std::map<std::string, int> setupCountPerType;
+    std::map<std::string, double> setupTimePerType;
+    ShiftCalendar calendar;
+    std::vector<CapacityChange> capacityTable; // compiled from the calendar at the start of each run
+    size_t nextCapacityChange = 0;
+    std::map<std::string, int> onDutyResources;
+
+    // Plant area of a site model: products finishing the stage before exitStage leave for the
+    // next area instead of going on here. exitCompletions holds the completion times of jobs
+    // already running on that stage, which bound when the next product can leave.
+    int exitStage = -1;
+    double transferTime = 0.0;
+    double minExitProcessTime = 0.0;
+    std::priority_queue<double, std::pmr::vector<double>, std::greater<double>> exitCompletions{ std::greater<double>(), std::pmr::vector<double>(&memory) };
+    std::pmr::vector<Transfer> outbox{ &memory };
+    int transferredProducts = 0;
 
 public:
-    ManufacturingSystem()
-        : rawMaterialArrivalDist(1.0), breakdownDist(0.0, 1.0) {
+    explicit ManufacturingSystem(unsigned long long initialSeed = 0)
+        : random(initialSeed), seed(initialSeed) {
         // Initialize resources and machines
         resources["machines"] = 10;
         resources["operators"] = 5;
-        availableResources = resources;
         resourceUsageTime["machines"] = 0.0;
         resourceUsageTime["operators"] = 0.0;
         resourceWaitingTime["machines"] = 0.0;
         resourceWaitingTime["operators"] = 0.0;
 
-        generator.seed(static_cast<unsigned>(std::time(nullptr)));
-
         // Initialize processing times for different product types
         processingTimes["ProductA"] = { 2.0, 1.5, 1.0, 1.0 };
         processingTimes["ProductB"] = { 3.0, 2.0, 1.5, 1.5 };
         productTypes["ProductA"] = 0;
-        productTypes["ProductB"] = 0;
+        productTypes["ProductB"] = 1;
         finishedProductsPerType["ProductA"] = 0;
         finishedProductsPerType["ProductB"] = 0;
 
         // Initialize machine setup times
         machineSetupTimes["ProductA"] = 0.5;
         machineSetupTimes["ProductB"] = 0.75;
+
+        // Changeovers between products cost more than setting up an idle machine from scratch
+        setupMatrix.reset({ machineSetupTimes["ProductA"], machineSetupTimes["ProductB"] });
+        setupMatrix.set(productTypes["ProductA"], productTypes["ProductB"], 1.0);
+        setupMatrix.set(productTypes["ProductB"], productTypes["ProductA"], 0.8);
+
+        // Machining is operator-attended; the other stages need an operator only
+        stageRequirements["machining"] = { {"machines", 1}, {"operators", 1} };
+        stageRequirements["assembly"] = { {"operators", 1} };
+        stageRequirements["quality_control"] = { {"operators", 1} };
+        stageRequirements["packaging"] = {};
+        initResources();
     }
 
-    void scheduleEvent(double time, const std::string& type, std::function<void()> action) {
-        eventQueue.push({ time, type, action });
+    void initResources() {
+        pools.clear(stageCount);
+        for (const auto& entry : resources) {
+            pools.addPool(entry.first, entry.second);
+        }
+        machinesPool = pools.find("machines");
+        // Every counter exists from the start, so the KPI set does not depend on which stages ran
+        for (int pool = 0; pool < pools.size(); pool++) {
+            resourceUsageTime[pools.name(pool)];
+        }
+        for (int stageIndex = 0; stageIndex < stageCount; stageIndex++) {
+            resourceUsageTime[getStageName(stageIndex)];
+            resourceWaitingTime[getStageName(stageIndex)];
+        }
+        stations.clear(setupMatrix.size());
+        auto machines = resources.find("machines");
+        machiningStation = stations.addStation("machining", machines != resources.end() ? machines->second : 0);
+
+        stageSeizeSets.assign(stageCount, SeizeSet());
+        stageStations.assign(stageCount, -1);
+        stageInProcess.assign(stageCount, 0);
+        bottlenecks.reset(stageCount, bottleneckPeriod);
+        stageBufferCapacity.assign(stageCount, -1);
+        for (const auto& entry : bufferCapacities) {
+            stageBufferCapacity[findStage(entry.first)] = entry.second;
+        }
+        blockedProducts.assign(stageCount, std::deque<Product>());
+        blockedTime.assign(stageCount, 0.0);
+        outcomeCumulative.assign(stageCount, std::vector<double>());
+        outcomeTargets.assign(stageCount, std::vector<int>());
+        for (const auto& entry : stageOutcomes) {
+            int stageIndex = findStage(entry.first);
+            double cumulative = 0.0;
+            for (const auto& outcome : entry.second) {
+                cumulative += outcome.second;
+                outcomeCumulative[stageIndex].push_back(cumulative);
+                outcomeTargets[stageIndex].push_back(outcome.first);
+            }
+        }
+        scrapCount.assign(stageCount, 0);
+        reworkCount.assign(stageCount, 0);
+        stageQueues.clear();
+        stageQueues.reserve(stageCount);
+        for (int stageIndex = 0; stageIndex < stageCount; stageIndex++) {
+            stageQueues.emplace_back(&memory);
+        }
+        for (int stageIndex = 0; stageIndex < stageCount; stageIndex++) {
+            auto rule = stageDispatchRules.find(getStageName(stageIndex));
+            if (rule != stageDispatchRules.end()) {
+                double totalTime = 0.0;
+                for (const auto& entry : processingTimes) {
+                    totalTime += entry.second[stageIndex];
+                }
+                stageQueues[stageIndex].setRule(rule->second, atcLookahead, totalTime / processingTimes.size());
+            }
+            for (const auto& demand : stageRequirements[getStageName(stageIndex)]) {
+                int pool = pools.find(demand.first);
+                if (pool < 0) {
+                    std::cout << "Unknown resource " << demand.first << " required by " << getStageName(stageIndex) << std::endl;
+                    continue;
+                }
+                stageSeizeSets[stageIndex].push_back({ pool, demand.second });
+                if (pool == machinesPool) {
+                    stageStations[stageIndex] = machiningStation;
+                }
+            }
+        }
+        std::vector<int> stagesUsing(pools.size(), 0);
+        for (const auto& seizeSet : stageSeizeSets) {
+            for (const auto& demand : seizeSet) {
+                stagesUsing[demand.pool]++;
+            }
+        }
+        heldWhileBlocked.assign(stageCount, SeizeSet());
+        freedWhenBlocked.assign(stageCount, SeizeSet());
+        for (int stageIndex = 0; stageIndex < stageCount; stageIndex++) {
+            for (const auto& demand : stageSeizeSets[stageIndex]) {
+                bool held = (demand.pool == machinesPool && stageStations[stageIndex] >= 0) || stagesUsing[demand.pool] == 1;
+                (held ? heldWhileBlocked : freedWhenBlocked)[stageIndex].push_back(demand);
+            }
+        }
+        stageWorkplaces.assign(stageCount, -1);
+        for (int stageIndex = 0; stageIndex + 1 < stageCount; stageIndex++) {
+            if (stageBufferCapacity[stageIndex + 1] < 0 || !heldWhileBlocked[stageIndex].empty()) {
+                continue;
+            }
+            for (const auto& demand : freedWhenBlocked[stageIndex]) {
+                if (demand.units > 0) {
+                    int places = resources.find(pools.name(demand.pool))->second / demand.units;
+                    int& workplaces = stageWorkplaces[stageIndex];
+                    workplaces = workplaces < 0 ? places : std::min(workplaces, places);
+                }
+            }
+        }
     }
 
-    void runSimulation(double runTime = 1000.0) {
-        // Schedule the first raw material arrival
-        scheduleEvent(rawMaterialArrivalDist(generator), "raw_material_arrival", [this] { handleRawMaterialArrival("ProductA"); });
+    // Returns the system to the state of a fresh run with the same model and a new seed.
+    // Containers are emptied rather than rebuilt, so a replication loop on one instance
+    // reuses the buffers grown by earlier runs.
+    void reset(unsigned long long newSeed) {
+        while (!eventQueue.empty()) {
+            eventQueue.pop();
+        }
+        eventSequence = 0;
+        currentTime = 0.0;
+        eventsProcessed = 0;
+        rawMaterialCount = 0;
+        finishedProducts = 0;
+        tardyProducts = 0;
+        totalTardiness = 0.0;
+
+        seed = newSeed;
+        random.seed(seed);
+
+        // Pools were added in the order of resources
+        pools.reset();
+        int pool = 0;
+        for (const auto& entry : resources) {
+            pools.setAvailable(pool++, entry.second);
+        }
+        stations.reset();
+        for (auto& queue : stageQueues) {
+            queue.clear();
+        }
+        wokenStages.clear();
+        stageInProcess.assign(stageCount, 0);
+        bottlenecks.reset(stageCount, bottleneckPeriod);
+        for (auto& blocked : blockedProducts) {
+            blocked.clear();
+        }
+        blockedTime.assign(stageCount, 0.0);
+        scrapCount.assign(stageCount, 0);
+        reworkCount.assign(stageCount, 0);
+        firstPassProducts = 0;
+        while (!exitCompletions.empty()) {
+            exitCompletions.pop();
+        }
+        outbox.clear();
+        transferredProducts = 0;
+
+        if (orderStream.isOpen()) {
+            orderStream.rewind();
+        }
+        orderUnitsLeft.clear();
+        orderDueDates.clear();
+        orderUnitsScrapped.clear();
+        freeOrderSlots.clear();
+        ordersReleased = 0;
+        ordersSkipped = 0;
+        releasePool.clear();
+        workInProcess = 0;
+        releasedWorkload = 0.0;
+        orderStats = DueDateStats();
+
+        // Counters keep their keys so the maps do not reallocate nodes
+        for (auto& entry : resourceUsageTime) {
+            entry.second = 0.0;
+        }
+        for (auto& entry : resourceWaitingTime) {
+            entry.second = 0.0;
+        }
+        for (auto& entry : finishedProductsPerType) {
+            entry.second = 0;
+        }
+        for (auto& entry : setupCountPerType) {
+            entry.second = 0;
+        }
+        for (auto& entry : setupTimePerType) {
+            entry.second = 0.0;
+        }
+        profiler.reset();
+    }
+
+    // Everything an area changes while it runs, saved between batches so an optimistic site can
+    // roll the area back. Order books, KPI sampling and live metrics are not part of it.
+    struct Checkpoint {
+        std::priority_queue<Event, std::pmr::vector<Event>, std::greater<Event>> eventQueue;
+        long long eventSequence = 0;
+        double currentTime = 0.0;
+        long long eventsProcessed = 0;
+        int rawMaterialCount = 0;
+        int finishedProducts = 0;
+        int tardyProducts = 0;
+        double totalTardiness = 0.0;
+        RandomStream random;
+        ResourcePools pools;
+        StationModel stations;
+        std::vector<DispatchQueue<Product>> stageQueues;
+        std::vector<int> stageInProcess;
+        BottleneckDetector bottlenecks;
+        std::vector<std::deque<Product>> blockedProducts;
+        std::vector<double> blockedTime;
+        std::vector<int> scrapCount;
+        std::vector<int> reworkCount;
+        int firstPassProducts = 0;
+        int workInProcess = 0;
+        double releasedWorkload = 0.0;
+        std::map<std::string, double> resourceUsageTime;
+        std::map<std::string, double> resourceWaitingTime;
+        std::map<std::string, int> finishedProductsPerType;
+        std::map<std::string, int> setupCountPerType;
+        std::map<std::string, double> setupTimePerType;
+        size_t nextCapacityChange = 0;
+        std::map<std::string, int> onDutyResources;
+        std::priority_queue<double, std::pmr::vector<double>, std::greater<double>> exitCompletions;
+        int transferredProducts = 0;
+    };
+
+    // Copy assignment keeps each container's own allocator, so restoring a checkpoint refills
+    // the arena-backed containers and saving into a reused checkpoint reuses its buffers
+    template <typename From, typename To>
+    static void copyRunState(const From& from, To& to) {
+        to.eventQueue = from.eventQueue;
+        to.eventSequence = from.eventSequence;
+        to.currentTime = from.currentTime;
+        to.eventsProcessed = from.eventsProcessed;
+        to.rawMaterialCount = from.rawMaterialCount;
+        to.finishedProducts = from.finishedProducts;
+        to.tardyProducts = from.tardyProducts;
+        to.totalTardiness = from.totalTardiness;
+        to.random = from.random;
+        to.pools = from.pools;
+        to.stations = from.stations;
+        to.stageQueues = from.stageQueues;
+        to.stageInProcess = from.stageInProcess;
+        to.bottlenecks = from.bottlenecks;
+        to.blockedProducts = from.blockedProducts;
+        to.blockedTime = from.blockedTime;
+        to.scrapCount = from.scrapCount;
+        to.reworkCount = from.reworkCount;
+        to.firstPassProducts = from.firstPassProducts;
+        to.workInProcess = from.workInProcess;
+        to.releasedWorkload = from.releasedWorkload;
+        to.resourceUsageTime = from.resourceUsageTime;
+        to.resourceWaitingTime = from.resourceWaitingTime;
+        to.finishedProductsPerType = from.finishedProductsPerType;
+        to.setupCountPerType = from.setupCountPerType;
+        to.setupTimePerType = from.setupTimePerType;
+        to.nextCapacityChange = from.nextCapacityChange;
+        to.onDutyResources = from.onDutyResources;
+        to.exitCompletions = from.exitCompletions;
+        to.transferredProducts = from.transferredProducts;
+    }
+
+    // Only valid between batches, when no stage wake-ups or transfers are pending
+    void saveCheckpoint(Checkpoint& checkpoint) const {
+        copyRunState(*this, checkpoint);
+    }
+
+    void restoreCheckpoint(const Checkpoint& checkpoint) {
+        copyRunState(checkpoint, *this);
+    }
+
+    bool canCheckpoint() const {
+        return !orderStream.isOpen() && sampleInterval == 0.0 && liveMetrics == nullptr;
+    }
 
-        // Schedule shift changes
-        scheduleEvent(shiftLength, "shift_change", [this] { handleShiftChange(); });
+    void scheduleEvent(double time, EventKind kind, const Product& product = Product(), long long origin = 0) {
+        eventQueue.push({ time, kind, eventPriority(kind), origin, eventSequence++, product });
+#ifdef MANUFACTURING_PROFILE
+        profiler.noteQueueSize(eventQueue.size());
+#endif
+    }
 
+    void runSimulation(double runTime = 1000.0) {
+        startRun(runTime);
         while (!eventQueue.empty() && currentTime < runTime) {
+            processBatch();
+        }
+        finishRun();
+    }
+
+    // Schedules the first arrivals and applies the calendar; runSimulation and the site model
+    // then drive the event loop
+    void startRun(double runTime) {
+        if (!orderStream.isOpen()) {
+            // Schedule the first raw material arrival; areas fed only by other areas have none
+            if (rawMaterialArrivalRate > 0.0) {
+                scheduleEvent(random.exponential(rawMaterialArrivalRate), EventKind::RawMaterialArrival, Product{ "ProductA", 0 });
+            }
+        }
+        else if (!orderStream.empty()) {
+            // Only the next order release is kept in the event queue
+            scheduleEvent(orderStream.nextReleaseDate(), EventKind::OrderRelease);
+        }
+
+        // Compile the shift calendar and apply the capacity on duty at time 0
+        capacityTable = calendar.compile(resources, runTime);
+        nextCapacityChange = 0;
+        onDutyResources = resources;
+        handleShiftChange();
+
+        if (sampleInterval > 0.0) {
+            timeSeries.configure(getSampleColumns(), sampleInterval, sampleBucket, runTime);
+            finishedAtLastSample = finishedProductsPerType;
+            scheduleEvent(sampleInterval, EventKind::KpiSample);
+        }
+    }
+
+    // Processes every event of the next timestamp as one batch, including those it schedules
+    // for the same instant; the heap hands them out by priority, then sequence
+    void processBatch() {
+        currentTime = eventQueue.top().time;
+        inBatch = true;
+        while (!eventQueue.empty() && eventQueue.top().time == currentTime) {
             Event currentEvent = eventQueue.top();
             eventQueue.pop();
-            currentTime = currentEvent.time;
-            currentEvent.action();
+            {
+                PROFILE_SCOPE(profiler, static_cast<int>(currentEvent.kind));
+                dispatch(currentEvent);
+            }
+            eventsProcessed++;
+            if (liveMetrics != nullptr) {
+                publishMetrics();
+            }
+        }
+        inBatch = false;
+        // Resources freed or added by the batch are handed out once, after all of its events
+        wakeStages();
+        updateBottlenecks();
+    }
+
+    // A stage holds up work while products wait for it, or while it is processing and could not
+    // start another job: its station has no idle machine or a pool it needs is used up
+    bool isStageActive(int stageIndex) const {
+        if (!stageQueues[stageIndex].empty()) {
+            return true;
+        }
+        if (stageInProcess[stageIndex] == 0) {
+            return false;
+        }
+        int station = stageStations[stageIndex];
+        if (station >= 0 && stations.idleCount(station) == 0) {
+            return true;
+        }
+        for (const auto& demand : stageSeizeSets[stageIndex]) {
+            if (pools.available(demand.pool) < demand.units) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // States only change inside batches, so checking once per batch sees every active period
+    void updateBottlenecks() {
+        for (int stageIndex = 0; stageIndex < stageCount; stageIndex++) {
+            bottlenecks.update(stageIndex, isStageActive(stageIndex), currentTime);
+        }
+    }
+
+    void dispatch(const Event& event) {
+        switch (event.kind) {
+        case EventKind::RawMaterialArrival: handleRawMaterialArrival(event.product.type); break;
+        case EventKind::OrderRelease: handleOrderRelease(); break;
+        case EventKind::Setup: finishSetup(event.product); break;
+        case EventKind::StageCompletion: completeStage(event.product); break;
+        case EventKind::ShiftChange: handleShiftChange(); break;
+        case EventKind::Maintenance: handleMaintenance(event.product.type); break;
+        case EventKind::KpiSample: handleKpiSample(); break;
+        case EventKind::TransferArrival: handleTransferArrival(event.product); break;
+        default: break;
+        }
+    }
+
+    // Processes every batch strictly before `limit`
+    void advanceTo(double limit) {
+        while (!eventQueue.empty() && eventQueue.top().time < limit) {
+            processBatch();
+        }
+    }
+
+    double nextEventTime() const {
+        return eventQueue.empty() ? std::numeric_limits<double>::infinity() : eventQueue.top().time;
+    }
+
+    // Earliest time a product sent on by this area can arrive at the next one: a job already on
+    // the exit stage finishes at its scheduled completion, any later job needs at least the
+    // shortest processing time of that stage
+    double exitBound() const {
+        if (exitStage < 0) {
+            return std::numeric_limits<double>::infinity();
+        }
+        double leave = nextEventTime() + minExitProcessTime;
+        if (!exitCompletions.empty()) {
+            leave = std::min(leave, exitCompletions.top());
         }
+        return leave + transferTime;
+    }
+
+    // Products that left since the last call, in the order they left
+    void takeTransfers(std::vector<Transfer>& transfers) {
+        transfers.insert(transfers.end(), outbox.begin(), outbox.end());
+        outbox.clear();
+    }
+
+    void receiveTransfer(const Transfer& transfer) {
+        scheduleEvent(transfer.time, EventKind::TransferArrival, transfer.product, transfer.origin);
+    }
+
+    void handleTransferArrival(const Product& product) {
+        const std::vector<double>& route = processingTimes[product.type];
+        workInProcess++;
+        releasedWorkload += std::accumulate(route.begin() + product.intermediateStage, route.end(), 0.0);
+        handleNextStage(product);
+    }
+
+    // Makes this system one area of a site model: products leave after the stage before
+    // `stage` and reach the next area `transfer` hours later. The transfer time is the
+    // area's lookahead and must be positive.
+    bool setExit(int stage, double transfer) {
+        if (stage <= 0 || stage >= stageCount || transfer <= 0.0) {
+            std::cout << "Area exit needs a stage between 1 and " << stageCount - 1 << " and a positive transfer time" << std::endl;
+            return false;
+        }
+        exitStage = stage;
+        transferTime = transfer;
+        minExitProcessTime = std::numeric_limits<double>::infinity();
+        for (const auto& entry : processingTimes) {
+            minExitProcessTime = std::min(minExitProcessTime, entry.second[stage - 1]);
+        }
+        return true;
+    }
+
+    // Mean raw material arrivals per hour; 0 for an area fed only by other areas
+    void setRawMaterialRate(double rate) {
+        rawMaterialArrivalRate = rate;
+    }
 
-        // Log data after simulation
-        logData("simulation_log.txt");
+    void finishRun() {
+        bottlenecks.finish(currentTime);
+        if (liveMetrics != nullptr) {
+            publishMetrics();
+            liveMetrics->endRun();
+        }
+#ifdef MANUFACTURING_PROFILE
+        std::cout << "Event profile:\n";
+        profiler.report(std::cout, profileSectionNames);
+#endif
     }
 
     void handleRawMaterialArrival(const std::string& productType) {
         rawMaterialCount++;
-        Product newProduct = { productType, 0 };
-        productQueue.push(newProduct);
-        std::cout << "Raw material for " << productType << " arrived at time " << currentTime << std::endl;
+        Product newProduct = { productType, 0, rawMaterialCount };
+        const std::vector<double>& route = processingTimes[productType];
+        newProduct.dueDate = currentTime + dueDateFactor * std::accumulate(route.begin(), route.end(), 0.0);
+        newProduct.weight = productWeight(productType);
+        if (trace) {
+            std::cout << "Raw material for " << productType << " arrived at time " << currentTime << std::endl;
+        }
 
         // Schedule the next raw material arrival
-        scheduleEvent(currentTime + rawMaterialArrivalDist(generator), "raw_material_arrival", [this, productType] { handleRawMaterialArrival(productType); });
+        scheduleEvent(currentTime + random.exponential(rawMaterialArrivalRate), EventKind::RawMaterialArrival, Product{ productType, 0 });
 
+        workInProcess++;
+        releasedWorkload += std::accumulate(route.begin(), route.end(), 0.0);
         handleNextStage(newProduct);
     }
 
+    // Moves every order due for release into the release pool as individual products
+    void handleOrderRelease() {
+        while (!orderStream.empty() && orderStream.nextReleaseDate() <= currentTime) {
+            Order order = orderStream.pop();
+            if (!processingTimes.count(order.productType)) {
+                ordersSkipped++;
+                continue;
+            }
+            if (trace) {
+                std::cout << "Order " << order.id << " for " << order.quantity << " " << order.productType << " released at time " << currentTime << std::endl;
+            }
+            int slot;
+            if (freeOrderSlots.empty()) {
+                slot = static_cast<int>(orderUnitsLeft.size());
+                orderUnitsLeft.push_back(0);
+                orderDueDates.push_back(0.0);
+                orderUnitsScrapped.push_back(0);
+            }
+            else {
+                slot = freeOrderSlots.back();
+                freeOrderSlots.pop_back();
+            }
+            orderUnitsLeft[slot] = order.quantity;
+            orderDueDates[slot] = order.dueDate;
+            orderUnitsScrapped[slot] = 0;
+            ordersReleased++;
+            for (int unit = 0; unit < order.quantity; unit++) {
+                rawMaterialCount++;
+                Product newProduct = { order.productType, 0, rawMaterialCount };
+                newProduct.dueDate = order.dueDate;
+                newProduct.weight = order.weight > 0.0 ? order.weight : productWeight(order.productType);
+                newProduct.order = slot;
+                releasePool.push_back(newProduct);
+            }
+        }
+        releaseFromPool();
+
+        if (!orderStream.empty()) {
+            scheduleEvent(orderStream.nextReleaseDate(), EventKind::OrderRelease);
+        }
+    }
+
+    // Lets pooled products into the shop for as long as the release policy allows
+    void releaseFromPool() {
+        while (!releasePool.empty()) {
+            const Product& next = releasePool.front();
+            const std::vector<double>& route = processingTimes[next.type];
+            double work = std::accumulate(route.begin(), route.end(), 0.0);
+            if (releasePolicy == ReleasePolicy::CONWIP && workInProcess >= wipLimit) {
+                return;
+            }
+            if (releasePolicy == ReleasePolicy::WorkloadControl && workInProcess > 0 && releasedWorkload + work > workloadNorm) {
+                return;
+            }
+            Product product = next;
+            releasePool.pop_front();
+            workInProcess++;
+            releasedWorkload += work;
+            handleNextStage(product);
+        }
+    }
+
+    // Queues a product at its stage without trying to start it
+    void enterQueue(Product& product) {
+        product.queuedSince = currentTime;
+        double processTime = processingTimes[product.type][product.intermediateStage];
+        stageQueues[product.intermediateStage].push(product, processTime, product.dueDate, product.weight);
+    }
+
     void handleNextStage(Product product) {
+        PROFILE_SCOPE(profiler, NextStageSection);
         if (product.intermediateStage < processingTimes[product.type].size()) {
-            double processTime = processingTimes[product.type][product.intermediateStage];
-            std::string stage = getStageName(product.intermediateStage);
-            if (availableResources[stage] > 0) {
-                // Schedule machine setup if needed
-                double setupTime = product.intermediateStage == 0 ? machineSetupTimes[product.type] : 0.0;
-                availableResources[stage]--;
-                scheduleEvent(currentTime + setupTime, "setup", [this, product, processTime, stage] {
-                    resourceUsageTime[stage] += processTime;
-                    scheduleEvent(currentTime + processTime, stage, [this, product] { completeStage(product); });
-                    });
-                resourceUsageTime[stage] += setupTime;
+            enterQueue(product);
+            if (inBatch) {
+                wokenStages.push_back(product.intermediateStage);
             }
             else {
-                resourceWaitingTime[stage] += processTime;
+                startWaitingProducts(product.intermediateStage);
+                // Products it let in from a full buffer freed resources upstream
+                wakeStages();
+            }
+        }
+    }
+
+    // True while every workplace of a stage is taken by products in process or blocked on it
+    bool workplacesTaken(int stageIndex) const {
+        int workplaces = stageWorkplaces[stageIndex];
+        return workplaces >= 0 && stageInProcess[stageIndex] + static_cast<int>(blockedProducts[stageIndex + 1].size()) >= workplaces;
+    }
+
+    // Starts queued products of a stage for as long as its whole seize set can be taken. A stage
+    // out of workplaces is not parked on a pool; freeWorkplace wakes it.
+    void startWaitingProducts(int stageIndex) {
+        DispatchQueue<Product>& queue = stageQueues[stageIndex];
+        while (!queue.empty()) {
+            if (workplacesTaken(stageIndex)) {
+                return;
+            }
+            int station = stageStations[stageIndex];
+            if (station >= 0 && stations.idleCount(station) == 0) {
+                pools.block(machinesPool, stageIndex);
+                return;
+            }
+            int shortPool = pools.trySeize(stageSeizeSets[stageIndex]);
+            if (shortPool >= 0) {
+                pools.block(shortPool, stageIndex);
+                return;
+            }
+            startStage(queue.pop(currentTime));
+            admitBlocked(stageIndex);
+        }
+    }
+
+    // A product finishing the stage before `stageIndex` waits while that buffer is full or
+    // others are already waiting for it
+    bool mustBlock(int stageIndex) const {
+        int capacity = stageBufferCapacity[stageIndex];
+        return capacity >= 0 && (!blockedProducts[stageIndex].empty() || stageQueues[stageIndex].size() >= static_cast<size_t>(capacity));
+    }
+
+    // A place just came free in the buffer of `stageIndex`: the longest blocked product moves
+    // into it and gives up its machine and what else it held upstream. Stages waiting for those are
+    // woken through wokenStages, so when they start a job and free a place in their own buffer
+    // the unblocking carries on upstream in the same wake-up pass.
+    void admitBlocked(int stageIndex) {
+        if (blockedProducts[stageIndex].empty() || stageQueues[stageIndex].size() >= static_cast<size_t>(stageBufferCapacity[stageIndex])) {
+            return;
+        }
+        Product product = blockedProducts[stageIndex].front();
+        blockedProducts[stageIndex].pop_front();
+        blockedTime[stageIndex] += currentTime - product.queuedSince;
+        if (product.server >= 0) {
+            stations.release(product.server, currentTime);
+            product.server = -1;
+        }
+        pools.release(heldWhileBlocked[stageIndex - 1], wokenStages);
+        freeWorkplace(stageIndex - 1);
+        enterQueue(product);
+    }
+
+    // A product left a workplace of the stage, to move on or out of the line
+    void freeWorkplace(int stageIndex) {
+        if (stageWorkplaces[stageIndex] >= 0 && !stageQueues[stageIndex].empty()) {
+            wokenStages.push_back(stageIndex);
+        }
+    }
+
+    // Time products spent blocked on the buffer of `stageIndex`, including those still blocked
+    double blockedTimeAt(int stageIndex) const {
+        double time = blockedTime[stageIndex];
+        for (const Product& product : blockedProducts[stageIndex]) {
+            time += currentTime - product.queuedSince;
+        }
+        return time;
+    }
+
+    void startStage(Product product) {
+        int stageIndex = product.intermediateStage;
+        double processTime = processingTimes[product.type][stageIndex];
+        std::string stage = getStageName(stageIndex);
+        resourceWaitingTime[stage] += currentTime - product.queuedSince;
+        for (const auto& demand : stageSeizeSets[stageIndex]) {
+            resourceUsageTime[pools.name(demand.pool)] += demand.units * processTime;
+        }
+
+        double setupTime = 0.0;
+        if (stageStations[stageIndex] >= 0) {
+            // Machine stages take a specific machine; setup depends on what that machine ran last
+            product.server = stations.acquire(stageStations[stageIndex], productTypes[product.type], product.id, currentTime, setupMatrix);
+            Server& machine = stations.server(product.server);
+            int productIndex = productTypes[product.type];
+            setupTime = setupMatrix.get(machine.lastProduct, productIndex);
+            if (setupTime > 0.0) {
+                setupCountPerType[product.type]++;
+                setupTimePerType[product.type] += setupTime;
+            }
+            machine.lastProduct = productIndex;
+        }
+
+        stageInProcess[stageIndex]++;
+        if (stageIndex == exitStage - 1) {
+            exitCompletions.push(currentTime + setupTime + processTime);
+        }
+        if (setupTime > 0.0) {
+            scheduleEvent(currentTime + setupTime, EventKind::Setup, product);
+        }
+        else {
+            if (product.server >= 0) {
+                stations.startProcessing(product.server);
             }
+            resourceUsageTime[stage] += processTime;
+            scheduleEvent(currentTime + processTime, EventKind::StageCompletion, product);
+        }
+    }
+
+    // The machine is set up: processing starts now
+    void finishSetup(const Product& product) {
+        double processTime = processingTimes[product.type][product.intermediateStage];
+        stations.startProcessing(product.server);
+        resourceUsageTime[getStageName(product.intermediateStage)] += processTime;
+        scheduleEvent(currentTime + processTime, EventKind::StageCompletion, product);
+    }
+
+    // Retries only the stages parked on pools that just gained capacity; during a batch the
+    // stages are collected and retried once the batch is done
+    void wakeStages() {
+        if (inBatch) {
+            return;
+        }
+        for (size_t i = 0; i < wokenStages.size(); i++) {
+            startWaitingProducts(wokenStages[i]);
         }
+        wokenStages.clear();
+    }
+
+    // Gives back the machine and resources a product holds at its stage
+    void releaseStage(Product& product) {
+        if (product.server >= 0) {
+            stations.release(product.server, currentTime);
+            product.server = -1;
+        }
+        pools.release(stageSeizeSets[product.intermediateStage], wokenStages);
+        freeWorkplace(product.intermediateStage);
     }
 
     void completeStage(Product product) {
         std::string stage = getStageName(product.intermediateStage);
-        std::cout << stage << " for " << product.type << " completed at time " << currentTime << std::endl;
-        availableResources[stage]++;
+        if (trace) {
+            std::cout << stage << " for " << product.type << " completed at time " << currentTime << std::endl;
+        }
+        releasedWorkload -= processingTimes[product.type][product.intermediateStage];
+        stageInProcess[product.intermediateStage]--;
+        if (product.intermediateStage == exitStage - 1) {
+            exitCompletions.pop();
+        }
+        int outcome = drawOutcome(product.intermediateStage);
+        if (outcome != PassOutcome) {
+            routeFailure(product, outcome);
+            return;
+        }
+        int nextStage = product.intermediateStage + 1;
+        if (nextStage < stageCount && nextStage != exitStage && mustBlock(nextStage)) {
+            // Blocked after service: stays on its machine, queuedSince marks when it got stuck
+            pools.release(freedWhenBlocked[product.intermediateStage], wokenStages);
+            wakeStages();
+            product.queuedSince = currentTime;
+            product.intermediateStage = nextStage;
+            blockedProducts[nextStage].push_back(product);
+            return;
+        }
+        releaseStage(product);
+        wakeStages();
         product.intermediateStage++;
-        if (product.intermediateStage >= processingTimes[product.type].size()) {
+        if (product.intermediateStage == exitStage) {
+            // Leaves for the next area with the work it still needs
+            const std::vector<double>& route = processingTimes[product.type];
+            releasedWorkload -= std::accumulate(route.begin() + exitStage, route.end(), 0.0);
+            workInProcess--;
+            outbox.push_back({ currentTime + transferTime, product, transferredProducts });
+            transferredProducts++;
+            releaseFromPool();
+        }
+        else if (product.intermediateStage >= processingTimes[product.type].size()) {
             finishedProducts++;
             finishedProductsPerType[product.type]++;
+            if (product.reworks == 0) {
+                firstPassProducts++;
+            }
+            if (currentTime > product.dueDate) {
+                tardyProducts++;
+                totalTardiness += currentTime - product.dueDate;
+            }
+            workInProcess--;
+            closeOrderUnit(product);
+            releaseFromPool();
         }
         else {
             handleNextStage(product);
         }
     }
 
-    std::string getStageName(int stageIndex) {
+    // Outcome of the stage a product just finished: PassOutcome, ScrapOutcome or the stage to redo from
+    int drawOutcome(int stageIndex) {
+        const std::vector<double>& cumulative = outcomeCumulative[stageIndex];
+        if (cumulative.empty()) {
+            return PassOutcome;
+        }
+        size_t outcome = std::upper_bound(cumulative.begin(), cumulative.end(), random.uniform()) - cumulative.begin();
+        return outcome < cumulative.size() ? outcomeTargets[stageIndex][outcome] : PassOutcome;
+    }
+
+    // Scraps the product or sends it back to `outcome`. Rework goes into the stage's queue
+    // even when its buffer is full, so the loop back cannot deadlock against blocked products.
+    void routeFailure(Product& product, int outcome) {
+        int stageIndex = product.intermediateStage;
+        const std::vector<double>& route = processingTimes[product.type];
+        releaseStage(product);
+        wakeStages();
+        if (outcome == ScrapOutcome) {
+            if (trace) {
+                std::cout << product.type << " scrapped after " << getStageName(stageIndex) << " at time " << currentTime << std::endl;
+            }
+            scrapCount[stageIndex]++;
+            releasedWorkload -= std::accumulate(route.begin() + stageIndex + 1, route.end(), 0.0);
+            workInProcess--;
+            closeOrderUnit(product, true);
+            releaseFromPool();
+            return;
+        }
+        if (trace) {
+            std::cout << product.type << " sent back from " << getStageName(stageIndex) << " to " << getStageName(outcome) << " at time " << currentTime << std::endl;
+        }
+        reworkCount[stageIndex]++;
+        product.reworks++;
+        releasedWorkload += std::accumulate(route.begin() + outcome, route.begin() + stageIndex + 1, 0.0);
+        product.intermediateStage = outcome;
+        handleNextStage(product);
+    }
+
+    // A unit of an order is done, finished or scrapped; the order closes with its last unit,
+    // as delivered if every unit finished and as short otherwise
+    void closeOrderUnit(const Product& product, bool scrapped = false) {
+        if (product.order < 0) {
+            return;
+        }
+        if (scrapped) {
+            orderUnitsScrapped[product.order]++;
+        }
+        if (--orderUnitsLeft[product.order] == 0) {
+            if (orderUnitsScrapped[product.order] > 0) {
+                orderStats.addShort();
+            }
+            else {
+                orderStats.add(currentTime, orderDueDates[product.order]);
+            }
+            freeOrderSlots.push_back(product.order);
+        }
+    }
+
+    std::string getStageName(int stageIndex) const {
         switch (stageIndex) {
         case 0: return "machining";
         case 1: return "assembly";
@@ -151,24 +1082,122 @@ public:
         }
     }
 
+    int findStage(const std::string& name) const {
+        for (int stageIndex = 0; stageIndex < stageCount; stageIndex++) {
+            if (getStageName(stageIndex) == name) {
+                return stageIndex;
+            }
+        }
+        return -1;
+    }
+
+    bool hasFiniteBuffers() const {
+        return !bufferCapacities.empty();
+    }
+
+    bool hasOutcomes() const {
+        return !stageOutcomes.empty();
+    }
+
+    int scrappedProducts() const {
+        return std::accumulate(scrapCount.begin(), scrapCount.end(), 0);
+    }
+
+    // `good` as a share of the products that left the line, finished or scrapped
+    double yieldOf(int good) const {
+        int resolved = finishedProducts + scrappedProducts();
+        return resolved > 0 ? static_cast<double>(good) / resolved : 0.0;
+    }
+
     void handleBreakdown(const std::string& resource) {
-        std::cout << "Breakdown occurred on " << resource << " at time " << currentTime << std::endl;
-        scheduleEvent(currentTime + 5.0, "maintenance", [this, resource] { handleMaintenance(resource); });
+        if (trace) {
+            std::cout << "Breakdown occurred on " << resource << " at time " << currentTime << std::endl;
+        }
+        pools.adjust(pools.find(resource), -1, wokenStages);
+        scheduleEvent(currentTime + 5.0, EventKind::Maintenance, Product{ resource, 0 });
     }
 
     void handleMaintenance(const std::string& resource) {
-        std::cout << "Maintenance completed on " << resource << " at time " << currentTime << std::endl;
-        availableResources[resource]++;
+        if (trace) {
+            std::cout << "Maintenance completed on " << resource << " at time " << currentTime << std::endl;
+        }
+        pools.adjust(pools.find(resource), 1, wokenStages);
+        wakeStages();
     }
 
     void handleShiftChange() {
-        std::cout << "Shift change at time " << currentTime << std::endl;
-
-        // Reset available resources for the new shift
-        availableResources = resources;
+        // Apply every capacity change due now. Only the difference is added to the available
+        // count, so units still busy when their shift ends are withdrawn once they are released.
+        while (nextCapacityChange < capacityTable.size() && capacityTable[nextCapacityChange].time <= currentTime) {
+            const CapacityChange& change = capacityTable[nextCapacityChange++];
+            pools.adjust(pools.find(change.resource), change.capacity - onDutyResources[change.resource], wokenStages);
+            onDutyResources[change.resource] = change.capacity;
+            if (trace) {
+                std::cout << "Shift change at time " << currentTime << ": " << change.resource << " on duty " << change.capacity << std::endl;
+            }
+        }
+        wakeStages();
 
         // Schedule the next shift change
-        scheduleEvent(currentTime + shiftLength, "shift_change", [this] { handleShiftChange(); });
+        if (nextCapacityChange < capacityTable.size()) {
+            scheduleEvent(capacityTable[nextCapacityChange].time, EventKind::ShiftChange);
+        }
+    }
+
+    std::vector<std::string> getSampleColumns() const {
+        std::vector<std::string> names = { "wip" };
+        for (int stageIndex = 0; stageIndex < stageCount; stageIndex++) {
+            names.push_back("queue." + getStageName(stageIndex));
+        }
+        for (int pool = 0; pool < pools.size(); pool++) {
+            names.push_back("utilization." + pools.name(pool));
+        }
+        for (const auto& entry : finishedProductsPerType) {
+            names.push_back("throughput." + entry.first);
+        }
+        return names;
+    }
+
+    // Takes one snapshot in the same column order as getSampleColumns
+    void handleKpiSample() {
+        sampleRow.clear();
+        sampleRow.push_back(workInProcess);
+        for (int stageIndex = 0; stageIndex < stageCount; stageIndex++) {
+            sampleRow.push_back(static_cast<double>(stageQueues[stageIndex].size()));
+        }
+        for (int pool = 0; pool < pools.size(); pool++) {
+            int onDuty = onDutyResources[pools.name(pool)];
+            sampleRow.push_back(onDuty > 0 ? static_cast<double>(onDuty - pools.available(pool)) / onDuty : 0.0);
+        }
+        for (const auto& entry : finishedProductsPerType) {
+            sampleRow.push_back((entry.second - finishedAtLastSample[entry.first]) / sampleInterval);
+            finishedAtLastSample[entry.first] = entry.second;
+        }
+        timeSeries.record(currentTime, sampleRow);
+        scheduleEvent(currentTime + sampleInterval, EventKind::KpiSample);
+    }
+
+    void publishMetrics() {
+        liveMetrics->events.store(liveMetrics->events.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        liveMetrics->simulatedTime.store(currentTime, std::memory_order_relaxed);
+        liveMetrics->eventQueueDepth.store(static_cast<long long>(eventQueue.size()), std::memory_order_relaxed);
+        liveMetrics->finishedProducts.store(finishedProducts, std::memory_order_relaxed);
+        liveMetrics->workInProcess.store(workInProcess, std::memory_order_relaxed);
+        liveMetrics->tardyProducts.store(tardyProducts, std::memory_order_relaxed);
+    }
+
+    // Live counters for the metrics endpoint; the caller starts a new run on them
+    void setLiveMetrics(LiveMetrics* metrics) {
+        liveMetrics = metrics;
+    }
+
+    bool writeTimeSeries(const std::string& filename) const {
+        return sampleInterval > 0.0 && timeSeries.writeCsv(filename);
+    }
+
+    void setSampling(double interval, int samplesPerBucket = 1) {
+        sampleInterval = interval;
+        sampleBucket = samplesPerBucket;
     }
 
     void logData(const std::string& filename) {
@@ -182,22 +1211,152 @@ public:
             for (const auto& entry : resourceWaitingTime) {
                 logFile << entry.first << ": " << entry.second << " time units\n";
             }
+            logFile << "Machine Setups:\n";
+            for (const auto& entry : setupTimePerType) {
+                logFile << entry.first << ": " << setupCountPerType[entry.first] << " setups, " << entry.second << " time units\n";
+            }
+            logFile << "Machine Busy Times:\n";
+            const Station& machining = stations.station(machiningStation);
+            for (int i = 0; i < machining.serverCount; i++) {
+                logFile << "machine " << i << ": " << stations.server(machining.firstServer + i).busyTime << " time units\n";
+            }
+            logFile << "Products waiting at end of run:\n";
+            for (int stageIndex = 0; stageIndex < stageCount; stageIndex++) {
+                logFile << getStageName(stageIndex) << ": " << stageQueues[stageIndex].size() << " units\n";
+            }
+            if (hasFiniteBuffers()) {
+                logFile << "Blocked after service (waiting for room in the next buffer):\n";
+                for (int stageIndex = 1; stageIndex < stageCount; stageIndex++) {
+                    logFile << getStageName(stageIndex - 1) << ": " << blockedTimeAt(stageIndex) << " time units, "
+                        << blockedProducts[stageIndex].size() << " units blocked at end of run\n";
+                }
+            }
+            if (hasOutcomes()) {
+                logFile << "Quality Outcomes:\n";
+                for (int stageIndex = 0; stageIndex < stageCount; stageIndex++) {
+                    if (!outcomeCumulative[stageIndex].empty()) {
+                        logFile << getStageName(stageIndex) << ": " << reworkCount[stageIndex] << " sent back for rework, " << scrapCount[stageIndex] << " scrapped\n";
+                    }
+                }
+                logFile << "Yield: " << yieldOf(finishedProducts) * 100.0 << " %, first pass yield: " << yieldOf(firstPassProducts) * 100.0 << " %\n";
+            }
+            logFile << "Tardy products: " << tardyProducts << "\n";
+            logFile << "Total tardiness: " << totalTardiness << " time units\n";
+            if (orderStream.isOpen()) {
+                logFile << "Order Performance:\n";
+                logFile << "Orders released: " << ordersReleased << "\n";
+                if (ordersSkipped > 0 || orderStream.lateOrders() > 0) {
+                    logFile << "Orders skipped (unknown product): " << ordersSkipped << ", released late (out of order): " << orderStream.lateOrders() << "\n";
+                }
+                logFile << "Orders completed: " << orderStats.count << "\n";
+                if (hasOutcomes()) {
+                    logFile << "Orders closed short (units scrapped): " << orderStats.shortCount << "\n";
+                }
+                logFile << "Service level: " << orderStats.serviceLevel() * 100.0 << " %\n";
+                logFile << "Total order tardiness: " << orderStats.totalTardiness << " time units\n";
+                logFile << "Total order earliness: " << orderStats.totalEarliness << " time units\n";
+                logFile << "Maximum order tardiness: " << orderStats.maxTardiness << " time units\n";
+                logFile << "Order lateness: mean " << orderStats.meanLateness << ", std dev " << orderStats.latenessStdDev() << " time units\n";
+            }
+#ifdef MANUFACTURING_PROFILE
+            logFile << "Event Profile:\n";
+            profiler.report(logFile, profileSectionNames);
+#endif
+            if (exitStage >= 0) {
+                logFile << "Products sent to the next area: " << transferredProducts << "\n";
+            }
             logFile << "Total finished products: " << finishedProducts << "\n";
             for (const auto& entry : finishedProductsPerType) {
                 logFile << entry.first << ": " << entry.second << " units\n";
             }
+            logFile << "Bottlenecks (active period method):\n";
+            bottlenecks.report(logFile, currentTime, [this](int stageIndex) { return getStageName(stageIndex); });
             logFile.close();
         }
     }
 
-    // Getter for available resources
-    std::map<std::string, int> getAvailableResources() const {
-        return availableResources;
+    // End-of-run KPIs as named values, in a fixed order for the results table
+    KpiVector getKpis() const {
+        KpiVector kpis;
+        kpis.push_back({ "finished_products", static_cast<double>(finishedProducts) });
+        for (const auto& entry : finishedProductsPerType) {
+            kpis.push_back({ "finished." + entry.first, static_cast<double>(entry.second) });
+        }
+        for (const auto& entry : resourceUsageTime) {
+            kpis.push_back({ "usage_time." + entry.first, entry.second });
+        }
+        for (const auto& entry : resourceWaitingTime) {
+            kpis.push_back({ "waiting_time." + entry.first, entry.second });
+        }
+        for (const auto& entry : setupTimePerType) {
+            kpis.push_back({ "setups." + entry.first, static_cast<double>(setupCountPerType.at(entry.first)) });
+            kpis.push_back({ "setup_time." + entry.first, entry.second });
+        }
+        for (int stageIndex = 0; stageIndex < stageCount; stageIndex++) {
+            kpis.push_back({ "queue_at_end." + getStageName(stageIndex), static_cast<double>(stageQueues[stageIndex].size()) });
+        }
+        if (hasFiniteBuffers()) {
+            for (int stageIndex = 1; stageIndex < stageCount; stageIndex++) {
+                kpis.push_back({ "blocked_time." + getStageName(stageIndex - 1), blockedTimeAt(stageIndex) });
+            }
+        }
+        if (hasOutcomes()) {
+            kpis.push_back({ "scrapped_products", static_cast<double>(scrappedProducts()) });
+            for (int stageIndex = 0; stageIndex < stageCount; stageIndex++) {
+                if (!outcomeCumulative[stageIndex].empty()) {
+                    kpis.push_back({ "scrap." + getStageName(stageIndex), static_cast<double>(scrapCount[stageIndex]) });
+                    kpis.push_back({ "rework." + getStageName(stageIndex), static_cast<double>(reworkCount[stageIndex]) });
+                }
+            }
+            kpis.push_back({ "yield", yieldOf(finishedProducts) });
+            kpis.push_back({ "first_pass_yield", yieldOf(firstPassProducts) });
+        }
+        kpis.push_back({ "tardy_products", static_cast<double>(tardyProducts) });
+        kpis.push_back({ "total_tardiness", totalTardiness });
+        if (exitStage >= 0) {
+            kpis.push_back({ "transferred_products", static_cast<double>(transferredProducts) });
+        }
+        if (orderStream.isOpen()) {
+            kpis.push_back({ "orders_released", static_cast<double>(ordersReleased) });
+            kpis.push_back({ "orders_completed", static_cast<double>(orderStats.count) });
+            if (hasOutcomes()) {
+                kpis.push_back({ "orders_short", static_cast<double>(orderStats.shortCount) });
+            }
+            kpis.push_back({ "service_level", orderStats.serviceLevel() });
+            kpis.push_back({ "order_tardiness", orderStats.totalTardiness });
+            kpis.push_back({ "order_earliness", orderStats.totalEarliness });
+            kpis.push_back({ "order_max_tardiness", orderStats.maxTardiness });
+            kpis.push_back({ "order_lateness_mean", orderStats.meanLateness });
+            kpis.push_back({ "order_lateness_stddev", orderStats.latenessStdDev() });
+        }
+        return kpis;
+    }
+
+    unsigned long long getSeed() const {
+        return seed;
+    }
+
+    long long getEventsProcessed() const {
+        return eventsProcessed;
+    }
+
+    // Getter for available resources
+    std::map<std::string, int> getAvailableResources() const {
+        std::map<std::string, int> availableResources;
+        for (int pool = 0; pool < pools.size(); pool++) {
+            availableResources[pools.name(pool)] = pools.available(pool);
+        }
+        return availableResources;
     }
 
     // Setter for available resources
     void setAvailableResources(const std::map<std::string, int>& newAvailableResources) {
-        availableResources = newAvailableResources;
+        for (const auto& entry : newAvailableResources) {
+            int pool = pools.find(entry.first);
+            if (pool >= 0) {
+                pools.setAvailable(pool, entry.second);
+            }
+        }
     }
 
     // Getter for resources
@@ -208,25 +1367,1529 @@ public:
     // Setter for resources
     void setResources(const std::map<std::string, int>& newResources) {
         resources = newResources;
-        availableResources = newResources; // Reset available resources as well
+        initResources(); // Reset available resources as well
+    }
+
+    // A stage runs each job on one machine of its station, so it cannot hold more than one
+    static bool isValidDemand(const std::string& resource, int units) {
+        return units >= 0 && (resource != "machines" || units <= 1);
+    }
+
+    // Units of each resource a stage holds at the same time, e.g. { {"machines", 1}, {"operators", 1} }
+    bool setStageRequirement(const std::string& stage, const std::map<std::string, int>& demands) {
+        if (findStage(stage) < 0) {
+            std::cout << "Unknown stage " << stage << std::endl;
+            return false;
+        }
+        for (const auto& demand : demands) {
+            if (!isValidDemand(demand.first, demand.second)) {
+                std::cout << "Cannot require " << demand.second << " " << demand.first << " for " << stage << ": a job holds at most one machine" << std::endl;
+                return false;
+            }
+        }
+        stageRequirements[stage] = demands;
+        initResources();
+        return true;
+    }
+
+    bool setSetupTime(const std::string& fromType, const std::string& toType, double time) {
+        if (!productTypes.count(fromType) || !productTypes.count(toType)) {
+            std::cout << "Cannot set a setup time between unknown products " << fromType << " and " << toType << std::endl;
+            return false;
+        }
+        setupMatrix.set(productTypes[fromType], productTypes[toType], time);
+        return true;
+    }
+
+    double productWeight(const std::string& productType) const {
+        auto weight = productWeights.find(productType);
+        return weight != productWeights.end() ? weight->second : 1.0;
+    }
+
+    // Weight of a product type for WSPT and ATC; orders that give their own weight override it
+    bool setProductWeight(const std::string& productType, double weight) {
+        if (!productTypes.count(productType) || !(weight > 0.0)) {
+            std::cout << "Cannot set weight " << weight << " for " << productType << ": expected a known product and a positive weight" << std::endl;
+            return false;
+        }
+        productWeights[productType] = weight;
+        return true;
+    }
+
+    bool setDispatchRule(const std::string& stage, DispatchRule rule) {
+        if (findStage(stage) < 0) {
+            std::cout << "Unknown stage " << stage << std::endl;
+            return false;
+        }
+        stageDispatchRules[stage] = rule;
+        initResources();
+        return true;
+    }
+
+    // Why the outcome cannot be added to `stage`, empty if it can
+    std::string outcomeError(const std::string& stage, const std::string& target, double probability) const {
+        int stageIndex = findStage(stage);
+        int targetIndex = target == "scrap" ? stageIndex : findStage(target); // scrap needs no stage to go back to
+        double total = probability;
+        auto outcomes = stageOutcomes.find(stage);
+        if (outcomes != stageOutcomes.end()) {
+            for (const auto& outcome : outcomes->second) {
+                total += outcome.second;
+            }
+        }
+        if (stageIndex < 0 || targetIndex == -1) {
+            return "Unknown stage " + (stageIndex < 0 ? stage : target);
+        }
+        if (targetIndex > stageIndex || probability <= 0.0 || total > 1.0 + 1e-9) {
+            std::ostringstream error;
+            error << "Cannot add outcome " << target << " " << probability << " to " << stage
+                << ": rework goes back to this or an earlier stage and a stage's outcomes add up to at most 1";
+            return error.str();
+        }
+        return "";
+    }
+
+    // After `stage`, scraps ("scrap") or sends back to redo from `target` a share `probability` of
+    // the products; whatever the outcomes of a stage leave over passes on
+    bool addStageOutcome(const std::string& stage, const std::string& target, double probability, bool apply = true) {
+        std::string error = outcomeError(stage, target, probability);
+        if (!error.empty()) {
+            std::cout << error << std::endl;
+            return false;
+        }
+        stageOutcomes[stage].push_back({ target == "scrap" ? ScrapOutcome : findStage(target), probability });
+        if (apply) {
+            initResources();
+        }
+        return true;
+    }
+
+    // Products allowed to wait for `stage`, at least 1; a negative capacity makes the buffer
+    // unlimited again. The first stage takes every arrival and cannot be limited.
+    bool setBufferCapacity(const std::string& stage, int capacity, bool apply = true) {
+        int stageIndex = findStage(stage);
+        if (stageIndex <= 0 || capacity == 0) {
+            std::cout << "A buffer needs a stage after the first and a capacity of at least 1: " << stage << " " << capacity << std::endl;
+            return false;
+        }
+        if (capacity < 0) {
+            bufferCapacities.erase(stage);
+        }
+        else {
+            bufferCapacities[stage] = capacity;
+        }
+        if (apply) {
+            initResources();
+        }
+        return true;
+    }
+
+    // Reads a model file of whitespace-separated lines; '#' starts a comment.
+    //   resource <name> <units>
+    //   requires <stage> <resource> <units>
+    //   processing <product> <machining> <assembly> <quality_control> <packaging>
+    //   setup <from product> <to product> <time>
+    //   weight <product> <weight>
+    //   dispatch <stage> FIFO|SPT|EDD|WSPT|ATC
+    //   atc_lookahead <k>
+    //   due_date_factor <factor>
+    //   orders <csv file>
+    //   order_window <orders read ahead>
+    //   release IMMEDIATE | CONWIP <wip limit> | WLC <workload norm>
+    //   trace on|off
+    //   sample_interval <hours> [samples per min/max/mean bucket]
+    //   bottleneck_period <hours>
+    //   buffer <stage> <capacity>
+    //   outcome <stage> scrap <probability> | outcome <stage> rework <stage to redo from> <probability>
+    //   cycle <hours>
+    //   shifts <first start> <length> <shifts per day> <crew> [<crew> ...] [rotate <days>]
+    //   break <offset into the shift> <length> [<resource> ...]
+    //   off <resource> <start in the cycle> <length>
+    //   non_working_days <day> [<day> ...]
+    // The calendar keys build the shift calendar of scenarios that do not bring their own; a crew
+    // is <resource>=<units>[,<resource>=<units>...] and shifts expands through addDailyShifts.
+    bool loadModel(const std::string& filename) {
+        std::ifstream modelFile(filename);
+        if (!modelFile.is_open()) {
+            std::cout << "Could not open model file " << filename << std::endl;
+            return false;
+        }
+        bool ok = true;
+        std::string ordersFile; // opened after the whole file, so order_window applies wherever it is
+        // Daily shifts are expanded after the whole file too, so cycle applies wherever it is
+        struct DailyShifts {
+            double start;
+            double length;
+            int perDay;
+            std::vector<std::map<std::string, int>> crews;
+            int rotateEveryDays;
+        };
+        std::vector<DailyShifts> dailyShifts;
+        ShiftCalendar modelCalendar;
+        bool hasCalendar = false;
+        std::vector<std::pair<int, std::string>> calendarResources; // (line, resource), checked once all resources are read
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(modelFile, line)) {
+            lineNumber++;
+            if (lineNumber == 1 && line.compare(0, 3, "\xEF\xBB\xBF") == 0) {
+                line.erase(0, 3); // UTF-8 byte order mark, as some editors save it
+            }
+            line = line.substr(0, line.find('#'));
+            std::istringstream fields(line);
+            std::string key;
+            if (!(fields >> key)) {
+                continue;
+            }
+            std::string name, other, ruleName;
+            int units = 0;
+            double value = 0.0;
+            double length = 0.0;
+            if (key == "resource" && fields >> name >> units) {
+                resources[name] = units;
+            }
+            else if (key == "requires" && fields >> name >> other >> units) {
+                if (findStage(name) < 0) {
+                    std::cout << filename << ":" << lineNumber << ": unknown stage " << name << std::endl;
+                    ok = false;
+                    continue;
+                }
+                if (!isValidDemand(other, units)) {
+                    std::cout << filename << ":" << lineNumber << ": a job holds at most one machine and no negative units" << std::endl;
+                    ok = false;
+                    continue;
+                }
+                stageRequirements[name][other] = units;
+            }
+            else if (key == "processing" && fields >> name) {
+                std::vector<double> times;
+                while (fields >> value) {
+                    times.push_back(value);
+                }
+                if (times.size() != static_cast<size_t>(stageCount) || !productTypes.count(name)) {
+                    std::cout << filename << ":" << lineNumber << ": expected a known product and " << stageCount << " processing times" << std::endl;
+                    ok = false;
+                    continue;
+                }
+                processingTimes[name] = times;
+            }
+            else if (key == "setup" && fields >> name >> other >> value && productTypes.count(name) && productTypes.count(other)) {
+                setupMatrix.set(productTypes[name], productTypes[other], value);
+            }
+            else if (key == "weight" && fields >> name >> value) {
+                if (!productTypes.count(name) || !(value > 0.0)) {
+                    std::cout << filename << ":" << lineNumber << ": expected a known product and a positive weight" << std::endl;
+                    ok = false;
+                    continue;
+                }
+                productWeights[name] = value;
+            }
+            else if (key == "dispatch" && fields >> name >> ruleName) {
+                DispatchRule rule;
+                if (findStage(name) < 0) {
+                    std::cout << filename << ":" << lineNumber << ": unknown stage " << name << std::endl;
+                    ok = false;
+                    continue;
+                }
+                if (!parseDispatchRule(ruleName, rule)) {
+                    std::cout << filename << ":" << lineNumber << ": unknown dispatching rule " << ruleName << std::endl;
+                    ok = false;
+                    continue;
+                }
+                stageDispatchRules[name] = rule;
+            }
+            else if (key == "atc_lookahead" && fields >> value) {
+                atcLookahead = value;
+            }
+            else if (key == "due_date_factor" && fields >> value) {
+                dueDateFactor = value;
+            }
+            else if (key == "orders" && fields >> name) {
+                ordersFile = name;
+            }
+            else if (key == "order_window" && fields >> units && units > 0) {
+                orderWindow = units;
+            }
+            else if (key == "release" && fields >> name) {
+                if (name == "IMMEDIATE") {
+                    releasePolicy = ReleasePolicy::Immediate;
+                }
+                else if (name == "CONWIP" && fields >> units) {
+                    releasePolicy = ReleasePolicy::CONWIP;
+                    wipLimit = units;
+                }
+                else if (name == "WLC" && fields >> value) {
+                    releasePolicy = ReleasePolicy::WorkloadControl;
+                    workloadNorm = value;
+                }
+                else {
+                    std::cout << filename << ":" << lineNumber << ": unknown release policy " << name << std::endl;
+                    ok = false;
+                }
+            }
+            else if (key == "trace" && fields >> name) {
+                trace = name != "off";
+            }
+            else if (key == "sample_interval" && fields >> value) {
+                sampleInterval = value;
+                sampleBucket = fields >> units ? units : 1;
+            }
+            else if (key == "bottleneck_period" && fields >> value && value > 0.0) {
+                bottleneckPeriod = value;
+            }
+            else if (key == "buffer" && fields >> name >> units) {
+                ok = setBufferCapacity(name, units, false) && ok;
+            }
+            else if (key == "cycle" && fields >> value && value > 0.0) {
+                modelCalendar.setCycleLength(value);
+                hasCalendar = true;
+            }
+            else if (key == "shifts") {
+                DailyShifts shifts = { 0.0, 0.0, 0, {}, 7 };
+                bool valid = static_cast<bool>(fields >> shifts.start >> shifts.length >> shifts.perDay)
+                    && shifts.start >= 0.0 && shifts.length > 0.0 && shifts.perDay >= 1;
+                std::map<std::string, int> crew;
+                while (valid && fields >> name) {
+                    if (name == "rotate") {
+                        valid = fields >> shifts.rotateEveryDays && shifts.rotateEveryDays >= 1 && !(fields >> name);
+                        break;
+                    }
+                    valid = parseCrew(name, crew);
+                    shifts.crews.push_back(crew);
+                    for (const auto& entry : crew) {
+                        calendarResources.push_back({ lineNumber, entry.first });
+                    }
+                }
+                if (!valid || shifts.crews.empty()) {
+                    std::cout << filename << ":" << lineNumber << ": expected shifts <first start> <length> <shifts per day> <resource>=<units>[,...] ... [rotate <days>]" << std::endl;
+                    ok = false;
+                    continue;
+                }
+                dailyShifts.push_back(shifts);
+                hasCalendar = true;
+            }
+            else if (key == "break" && fields >> value >> length) {
+                std::vector<std::string> names;
+                if (value < 0.0 || length <= 0.0) {
+                    std::cout << filename << ":" << lineNumber << ": expected break <offset into the shift> <length> [<resource> ...]" << std::endl;
+                    ok = false;
+                    continue;
+                }
+                while (fields >> name) {
+                    names.push_back(name);
+                    calendarResources.push_back({ lineNumber, name });
+                }
+                modelCalendar.addBreak(value, length, names);
+                hasCalendar = true;
+            }
+            else if (key == "off" && fields >> name >> value >> length) {
+                if (length <= 0.0) {
+                    std::cout << filename << ":" << lineNumber << ": expected off <resource> <start in the cycle> <length>" << std::endl;
+                    ok = false;
+                    continue;
+                }
+                calendarResources.push_back({ lineNumber, name });
+                modelCalendar.addOffWindow(name, value, length);
+                hasCalendar = true;
+            }
+            else if (key == "non_working_days") {
+                std::vector<int> days;
+                bool valid = true;
+                while (fields >> units) {
+                    valid = valid && units >= 0 && units <= 6;
+                    days.push_back(units);
+                }
+                if (!valid || days.empty() || !fields.eof()) {
+                    std::cout << filename << ":" << lineNumber << ": expected non_working_days <day 0-6> ..., with 0 the first day of the run" << std::endl;
+                    ok = false;
+                    continue;
+                }
+                modelCalendar.setNonWorkingDays(days);
+                hasCalendar = true;
+            }
+            else if (key == "outcome" && fields >> name >> other) {
+                std::string target = "scrap";
+                if (other == "rework" && !(fields >> target)) {
+                    target.clear();
+                }
+                if ((other != "scrap" && other != "rework") || target.empty() || (other == "rework" && target == "scrap") || !(fields >> value)) {
+                    std::cout << filename << ":" << lineNumber << ": expected outcome <stage> scrap <probability> or outcome <stage> rework <stage> <probability>" << std::endl;
+                    ok = false;
+                    continue;
+                }
+                std::string error = outcomeError(name, target, value);
+                if (!error.empty()) {
+                    std::cout << filename << ":" << lineNumber << ": " << error << std::endl;
+                    ok = false;
+                    continue;
+                }
+                addStageOutcome(name, target, value, false);
+            }
+            else {
+                std::cout << filename << ":" << lineNumber << ": cannot parse '" << line << "'" << std::endl;
+                ok = false;
+            }
+        }
+        if (!ordersFile.empty()) {
+            ok = loadOrders(ordersFile) && ok;
+        }
+        for (const auto& reference : calendarResources) {
+            if (!resources.count(reference.second)) {
+                std::cout << filename << ":" << reference.first << ": unknown resource " << reference.second << std::endl;
+                ok = false;
+            }
+        }
+        for (const DailyShifts& shifts : dailyShifts) {
+            modelCalendar.addDailyShifts(shifts.start, shifts.length, shifts.perDay, shifts.crews, shifts.rotateEveryDays);
+        }
+        if (hasCalendar) {
+            calendar = modelCalendar;
+        }
+        initResources();
+        return ok;
+    }
+
+    // Streams an order book CSV (order_id,product_type,quantity,release_date,due_date[,weight]) sorted
+    // by release date; orders up to orderWindow lines out of place are still released in order
+    bool loadOrders(const std::string& filename) {
+        return orderStream.open(filename, orderWindow);
+    }
+
+    void loadOrderText(const std::string& csv) {
+        orderStream.openText(csv, orderWindow);
+    }
+
+    void setReleasePolicy(ReleasePolicy policy, int newWipLimit, double newWorkloadNorm) {
+        releasePolicy = policy;
+        wipLimit = newWipLimit;
+        workloadNorm = newWorkloadNorm;
+    }
+
+    void setTrace(bool enabled) {
+        trace = enabled;
+    }
+
+    void setCalendar(const ShiftCalendar& newCalendar) {
+        calendar = newCalendar;
     }
 };
 
-void runScenario(const std::string& productType, int machineCount, int operatorCount, double runTime) {
-    ManufacturingSystem system;
-    std::map<std::string, int> resources = {
-        {"machines", machineCount},
-        {"operators", operatorCount}
+// The default model as a fixed line for high-volume replications: same stages, resources,
+// routings and raw material stream, without setups, dispatching rules or a shift calendar
+struct FlagshipLine {
+    enum Pool { Machines, Operators, PoolCount };
+    static constexpr const char* poolNames[PoolCount] = { "machines", "operators" };
+
+    struct Machining : Stage<Uses<Machines, 1>, Uses<Operators, 1>> { static constexpr const char* name = "machining"; };
+    struct Assembly : Stage<Uses<Operators, 1>> { static constexpr const char* name = "assembly"; };
+    struct QualityControl : Stage<Uses<Operators, 1>> { static constexpr const char* name = "quality_control"; };
+    struct Packaging : Stage<> { static constexpr const char* name = "packaging"; };
+    typedef std::tuple<Machining, Assembly, QualityControl, Packaging> Stages;
+
+    struct ProductA {
+        static constexpr const char* name = "ProductA";
+        static constexpr double arrivalRate = 1.0;
+        static constexpr std::array<double, 4> processing = { { 2.0, 1.5, 1.0, 1.0 } };
     };
+    struct ProductB {
+        static constexpr const char* name = "ProductB";
+        static constexpr double arrivalRate = 0.0; // no raw material stream, as in the default model
+        static constexpr std::array<double, 4> processing = { { 3.0, 2.0, 1.5, 1.5 } };
+    };
+    typedef std::tuple<ProductA, ProductB> Products;
+};
+
+// One configuration of a sweep
+struct Scenario {
+    std::string productType;
+    int machineCount;
+    int operatorCount;
+    double runTime;
+    ShiftCalendar calendar;
+    std::string modelFile;
+
+    std::string name() const {
+        return "scenario_" + productType + "_machines_" + std::to_string(machineCount) + "_operators_" + std::to_string(operatorCount);
+    }
+};
+
+// Seed of one run. It depends only on the sweep's base seed, the scenario's position in the
+// sweep and the replication number, never on which worker runs it or in what order.
+unsigned long long replicationSeed(unsigned long long baseSeed, int scenarioIndex, int replication) {
+    return mixSeed(mixSeed(baseSeed, scenarioIndex), replication);
+}
+
+// False if the scenario's model file cannot be read in full; the scenario must not be run then
+bool configureScenario(ManufacturingSystem& system, const Scenario& scenario) {
+    if (!scenario.modelFile.empty() && !system.loadModel(scenario.modelFile)) {
+        std::cout << "Model file " << scenario.modelFile << " has errors; not running " << scenario.name() << std::endl;
+        return false;
+    }
+    std::map<std::string, int> resources = system.getResources();
+    resources["machines"] = scenario.machineCount;
+    resources["operators"] = scenario.operatorCount;
     system.setResources(resources);
-    system.runSimulation(runTime);
-    system.logData("scenario_" + productType + "_machines_" + std::to_string(machineCount) + "_operators_" + std::to_string(operatorCount) + ".txt");
+    if (!scenario.calendar.empty() || scenario.modelFile.empty()) {
+        system.setCalendar(scenario.calendar); // otherwise the model file's calendar, if it has one, applies
+    }
+    return true;
+}
+
+// Hash of the model file and of the order files it names; the built-in model has its own
+std::string modelFingerprint(const std::string& modelFile) {
+    unsigned long long hash = fnv1a(resultCacheVersion);
+    if (modelFile.empty()) {
+        return hashText(fnv1a("built-in model", hash));
+    }
+    std::ifstream file(modelFile);
+    std::string line;
+    while (std::getline(file, line)) {
+        hash = fnv1a(line + "\n", hash);
+        std::istringstream fields(line);
+        std::string key;
+        std::string ordersFile;
+        if (fields >> key >> ordersFile && key == "orders") {
+            std::ifstream orders(ordersFile);
+            std::string order;
+            while (std::getline(orders, order)) {
+                hash = fnv1a(order + "\n", hash);
+            }
+        }
+    }
+    return hashText(hash);
+}
+
+// Configurations can only be compared when they share the model and the run length
+std::string cacheContext(const std::string& modelHash, double runTime) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.17g", runTime);
+    return hashText(fnv1a(text, fnv1a(modelHash)));
+}
+
+// Numeric description of a scenario for the surrogate: machines, operators and the average
+// number of operators on duty over the run under the scenario's calendar
+std::vector<double> scenarioFeatures(const Scenario& scenario) {
+    double onDuty = scenario.operatorCount;
+    if (!scenario.calendar.empty()) {
+        double area = 0.0;
+        double since = 0.0;
+        int capacity = scenario.operatorCount;
+        for (const auto& change : scenario.calendar.compile({ {"operators", scenario.operatorCount} }, scenario.runTime)) {
+            area += capacity * (change.time - since);
+            since = change.time;
+            capacity = change.capacity;
+        }
+        area += capacity * (scenario.runTime - since);
+        onDuty = area / scenario.runTime;
+    }
+    return { static_cast<double>(scenario.machineCount), static_cast<double>(scenario.operatorCount), onDuty };
+}
+
+// Cache entry for a scenario's runs, without seed and KPIs. The key covers everything a run's
+// results depend on apart from the seed; the scenario's name is only a label and is left out.
+CachedRun scenarioCacheEntry(const Scenario& scenario) {
+    CachedRun entry;
+    std::string modelHash = modelFingerprint(scenario.modelFile);
+    entry.context = cacheContext(modelHash, scenario.runTime);
+    entry.config = hashText(fnv1a(scenario.calendar.canonical(), fnv1a(entry.context + " machines " + std::to_string(scenario.machineCount)
+        + " operators " + std::to_string(scenario.operatorCount) + " ")));
+    entry.features = scenarioFeatures(scenario);
+    return entry;
+}
+
+// Runs every (scenario, replication) of a sweep on `workers` threads. A worker builds a model
+// once per scenario and resets it with the run's seed between replications. KPIs are kept per
+// run and written in sweep order at the end, so the table is the same for any worker count.
+// Logs and time series are written for the first replication of each scenario only.
+// With a cache, runs already in it are taken from there (and write no logs) and new runs are added.
+// False, with nothing written to the table, if a scenario's model cannot be loaded.
+bool runSweep(const std::vector<Scenario>& scenarios, int replications, unsigned long long baseSeed, int workers, ResultsWriter& results,
+    LiveMetrics* metrics = nullptr, ResultCache* cache = nullptr) {
+    int runCount = static_cast<int>(scenarios.size()) * replications;
+    std::vector<KpiVector> kpis(runCount);
+    std::vector<CachedRun> entries;
+    std::vector<bool> cached(runCount, false);
+    if (cache != nullptr) {
+        int hits = 0;
+        for (const Scenario& scenario : scenarios) {
+            entries.push_back(scenarioCacheEntry(scenario));
+        }
+        for (int run = 0; run < runCount; run++) {
+            const CachedRun* found = cache->find(entries[run / replications].config, replicationSeed(baseSeed, run / replications, run % replications));
+            if (found != nullptr) {
+                kpis[run] = found->kpis;
+                cached[run] = true;
+                hits++;
+            }
+        }
+        std::cout << "Result cache: " << hits << " of " << runCount << " runs already simulated" << std::endl;
+    }
+    std::atomic<int> nextRun{ 0 };
+    std::atomic<bool> failed{ false };
+    auto work = [&] {
+        std::unique_ptr<ManufacturingSystem> system;
+        int loadedScenario = -1;
+        for (int run = nextRun++; run < runCount && !failed; run = nextRun++) {
+            if (cached[run]) {
+                continue;
+            }
+            int scenarioIndex = run / replications;
+            int replication = run % replications;
+            const Scenario& scenario = scenarios[scenarioIndex];
+            if (scenarioIndex != loadedScenario) {
+                system.reset(new ManufacturingSystem());
+                system->setLiveMetrics(metrics);
+                if (!configureScenario(*system, scenario)) {
+                    failed = true;
+                    return;
+                }
+                loadedScenario = scenarioIndex;
+            }
+            system->reset(replicationSeed(baseSeed, scenarioIndex, replication));
+            if (metrics != nullptr) {
+                metrics->beginRun(scenario.name());
+            }
+            system->runSimulation(scenario.runTime);
+            if (replication == 0) {
+                system->logData(scenario.name() + ".txt");
+                system->writeTimeSeries(scenario.name() + "_timeseries.csv");
+            }
+            kpis[run] = system->getKpis();
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int worker = 1; worker < workers; worker++) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (failed) {
+        return false;
+    }
+    for (int run = 0; run < runCount; run++) {
+        int scenarioIndex = run / replications;
+        int replication = run % replications;
+        unsigned long long seed = replicationSeed(baseSeed, scenarioIndex, replication);
+        results.addReplication(scenarios[scenarioIndex].name(), replication, seed, kpis[run]);
+        if (cache != nullptr && !cached[run]) {
+            CachedRun entry = entries[scenarioIndex];
+            entry.seed = seed;
+            entry.kpis = kpis[run];
+            cache->insert(entry);
+        }
+    }
+    return true;
+}
+
+// Runs a scenario's resource levels on the compiled flagship line, one instance for all replications
+void runFixedLine(const Scenario& scenario, int scenarioIndex, int replications, unsigned long long baseSeed, ResultsWriter& results) {
+    FixedLineSystem<FlagshipLine> line({ scenario.machineCount, scenario.operatorCount });
+    for (int replication = 0; replication < replications; replication++) {
+        line.reset(replicationSeed(baseSeed, scenarioIndex, replication));
+        line.runSimulation(scenario.runTime);
+        results.addReplication("fixed_" + scenario.name(), replication, line.getSeed(), line.getKpis());
+    }
+}
+
+// Every line feeds the last area
+template <typename Site>
+SiteStats runSiteAreas(Site& site, std::vector<std::unique_ptr<ManufacturingSystem>>& areas, double runTime, int threads) {
+    int lines = static_cast<int>(areas.size()) - 1;
+    for (auto& area : areas) {
+        site.addArea(*area);
+    }
+    for (int line = 0; line < lines; line++) {
+        site.connect(line, lines);
+    }
+    return site.run(runTime, threads);
+}
+
+// What a farm worker must share with its coordinator: the simulator version (resultCacheVersion,
+// bumped whenever results change) and, per scenario, its name and the model and order files
+std::string sweepFingerprint(const std::vector<Scenario>& scenarios) {
+    std::string fingerprint = std::string("v") + resultCacheVersion;
+    std::map<std::string, std::string> modelHashes;
+    for (const Scenario& scenario : scenarios) {
+        auto model = modelHashes.find(scenario.modelFile);
+        if (model == modelHashes.end()) {
+            model = modelHashes.insert({ scenario.modelFile, modelFingerprint(scenario.modelFile) }).first;
+        }
+        fingerprint += "|" + scenario.name() + ":" + model->second;
+    }
+    return fingerprint;
+}
+
+// runSweep on worker processes: unit = scenario * replications + replication, with the same
+// seeds and the same row order as runSweep, so results do not depend on which worker ran what.
+// `spawn` local workers are started from `program` for runs on one machine, once the coordinator
+// listens. The farm gives up after `idleTimeout` seconds without any worker.
+bool runFarmSweep(const std::vector<Scenario>& scenarios, int replications, unsigned long long baseSeed, int port, int spawn,
+    double unitTimeout, double idleTimeout, const std::string& program, const std::string& modelFile, ResultsWriter& results) {
+    int runCount = static_cast<int>(scenarios.size()) * replications;
+    auto describe = [&](int run) {
+        int scenarioIndex = run / replications;
+        int replication = run % replications;
+        return std::to_string(scenarioIndex) + " " + std::to_string(replication) + " " + std::to_string(replicationSeed(baseSeed, scenarioIndex, replication));
+    };
+    std::string command = "\"" + program + "\" " + (modelFile.empty() ? "" : "\"" + modelFile + "\" ") + "--worker 127.0.0.1:" + std::to_string(port);
+#ifdef _WIN32
+    command = "\"" + command + "\""; // cmd strips the outer pair of quotes
+#endif
+    FarmCoordinator coordinator(sweepFingerprint(scenarios));
+    coordinator.setUnitTimeout(unitTimeout);
+    coordinator.setIdleTimeout(idleTimeout);
+    if (!coordinator.listen(port)) {
+        return false;
+    }
+    std::vector<std::thread> spawned;
+    for (int worker = 0; worker < spawn; worker++) {
+        spawned.emplace_back([command] { std::system(command.c_str()); });
+    }
+
+    std::vector<KpiVector> kpis;
+    FarmStats stats;
+    auto start = std::chrono::steady_clock::now();
+    bool ok = coordinator.run(runCount, describe, kpis, stats);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (auto& thread : spawned) {
+        thread.join();
+    }
+    if (!ok) {
+        return false;
+    }
+    std::cout << "Farm: " << runCount << " runs on " << stats.workersSeen << " workers in " << seconds << " s, "
+        << stats.workersLost << " workers lost, " << stats.unitsRequeued << " runs handed out again" << std::endl;
+    for (int run = 0; run < runCount; run++) {
+        int scenarioIndex = run / replications;
+        int replication = run % replications;
+        results.addReplication(scenarios[scenarioIndex].name(), replication, replicationSeed(baseSeed, scenarioIndex, replication), kpis[run]);
+    }
+    return true;
+}
+
+// Worker side of runFarmSweep: one model per scenario, reset for every replication
+bool runFarmWorkerSweep(const std::vector<Scenario>& scenarios, const std::string& coordinator) {
+    size_t colon = coordinator.rfind(':');
+    if (colon == std::string::npos) {
+        std::cout << "Expected --worker <host>:<port>" << std::endl;
+        return false;
+    }
+    std::unique_ptr<ManufacturingSystem> system;
+    int loadedScenario = -1;
+    auto runUnit = [&](const std::string& request, KpiVector& kpis) {
+        std::istringstream fields(request);
+        int scenarioIndex = -1;
+        int replication = 0;
+        unsigned long long seed = 0;
+        if (!(fields >> scenarioIndex >> replication >> seed) || scenarioIndex < 0 || scenarioIndex >= static_cast<int>(scenarios.size())) {
+            std::cout << "Bad farm request: " << request << std::endl;
+            return false;
+        }
+        const Scenario& scenario = scenarios[scenarioIndex];
+        if (scenarioIndex != loadedScenario) {
+            system.reset(new ManufacturingSystem());
+            if (!configureScenario(*system, scenario)) {
+                return false;
+            }
+            system->setTrace(false);
+            loadedScenario = scenarioIndex;
+        }
+        system->reset(seed);
+        system->runSimulation(scenario.runTime);
+        if (replication == 0) {
+            system->logData(scenario.name() + ".txt");
+            system->writeTimeSeries(scenario.name() + "_timeseries.csv");
+        }
+        kpis = system->getKpis();
+        return true;
+    };
+    return runFarmWorker(coordinator.substr(0, colon), std::atoi(coordinator.c_str() + colon + 1), sweepFingerprint(scenarios), runUnit);
 }
 
-int main() {
+// Configuration space of the optimizer, read from a file of lines
+//   machines <min> <max>             operators <min> <max>
+//   shift_hours <h> ...              operator shift lengths to try; 24 means round the clock
+//   machine_cost <per machine>       operator_cost <per operator and shift hour>
+//   budget <cost>                    configurations above it are not simulated
+//   objective <kpi>                  maximized, default finished_products
+//   indifference <objective units>   differences too small to matter, for the reported confidence
+//   run_time <hours>                 initial_replications <n>    replications <total budget>
+//   round <replications per round>
+// The replication budget must cover the initial round, initial_replications per configuration.
+struct OptimizationSpace {
+    int minMachines = 6;
+    int maxMachines = 14;
+    int minOperators = 3;
+    int maxOperators = 9;
+    std::vector<double> shiftHours = { 24.0 };
+    double machineCost = 10.0;
+    double operatorCost = 1.0;
+    double budget = std::numeric_limits<double>::infinity();
+    std::string objective = "finished_products";
+    double indifference = 0.0;
+    double runTime = 1000.0;
+    int initialReplications = 5;
+    int totalReplications = 400;
+    int roundReplications = 20;
+
+    double cost(int machines, int operators, double hours) const {
+        return machines * machineCost + operators * hours * operatorCost;
+    }
+
+    bool load(const std::string& filename) {
+        std::ifstream file(filename);
+        if (!file.is_open()) {
+            std::cout << "Could not open optimization file " << filename << std::endl;
+            return false;
+        }
+        bool ok = true;
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(file, line)) {
+            lineNumber++;
+            line = line.substr(0, line.find('#'));
+            std::istringstream fields(line);
+            std::string key;
+            if (!(fields >> key)) {
+                continue;
+            }
+            double value = 0.0;
+            bool parsed = true;
+            if (key == "machines") {
+                parsed = static_cast<bool>(fields >> minMachines >> maxMachines) && minMachines >= 1 && minMachines <= maxMachines;
+            }
+            else if (key == "operators") {
+                parsed = static_cast<bool>(fields >> minOperators >> maxOperators) && minOperators >= 1 && minOperators <= maxOperators;
+            }
+            else if (key == "shift_hours") {
+                shiftHours.clear();
+                while (fields >> value) {
+                    parsed = parsed && value > 0.0 && value <= 24.0;
+                    shiftHours.push_back(value);
+                }
+                parsed = parsed && !shiftHours.empty();
+            }
+            else if (key == "machine_cost") {
+                parsed = static_cast<bool>(fields >> machineCost);
+            }
+            else if (key == "operator_cost") {
+                parsed = static_cast<bool>(fields >> operatorCost);
+            }
+            else if (key == "budget") {
+                parsed = static_cast<bool>(fields >> budget);
+            }
+            else if (key == "objective") {
+                parsed = static_cast<bool>(fields >> objective);
+            }
+            else if (key == "indifference") {
+                parsed = static_cast<bool>(fields >> indifference) && indifference >= 0.0;
+            }
+            else if (key == "run_time") {
+                parsed = static_cast<bool>(fields >> runTime) && runTime > 0.0;
+            }
+            else if (key == "initial_replications") {
+                parsed = static_cast<bool>(fields >> initialReplications) && initialReplications >= 2;
+            }
+            else if (key == "replications") {
+                parsed = static_cast<bool>(fields >> totalReplications);
+            }
+            else if (key == "round") {
+                parsed = static_cast<bool>(fields >> roundReplications) && roundReplications >= 1;
+            }
+            else {
+                parsed = false;
+            }
+            if (!parsed) {
+                std::cout << filename << ":" << lineNumber << ": cannot use line: " << line << std::endl;
+                ok = false;
+            }
+        }
+        return ok;
+    }
+};
+
+// Operators on duty for `hours` from 06:00 every day; machines are always available
+ShiftCalendar operatorShift(double hours, int operators) {
+    ShiftCalendar calendar;
+    if (hours < 24.0) {
+        calendar.addShift(6.0, hours, { {"operators", operators} });
+    }
+    return calendar;
+}
+
+double kpiValue(const KpiVector& kpis, const std::string& name) {
+    for (const auto& kpi : kpis) {
+        if (kpi.first == name) {
+            return kpi.second;
+        }
+    }
+    return 0.0;
+}
+
+// Simulation-based optimization: every configuration within the cost budget is a candidate and
+// OCBA spreads the replication budget over them, round by round, until it is spent. Replication
+// r of every candidate uses the same seed (common random numbers), so candidates are compared
+// on the same arrivals. Candidates are numbered cheapest first, so equal results go to the
+// cheaper configuration. Allocation depends only on results, never on thread timing. Runs found
+// in the cache are not simulated again, so a repeated or widened search only pays for new runs.
+// False if the space cannot be searched: no candidate, an initial round above the replication
+// budget, an objective that is not a KPI or a model file with errors.
+bool runOptimization(const OptimizationSpace& space, const std::string& modelFile, unsigned long long baseSeed, int workers, ResultsWriter& results,
+    ResultCache* cache = nullptr) {
+    std::vector<std::pair<double, Scenario>> priced;
+    for (double hours : space.shiftHours) {
+        for (int machines = space.minMachines; machines <= space.maxMachines; machines++) {
+            for (int operators = space.minOperators; operators <= space.maxOperators; operators++) {
+                double cost = space.cost(machines, operators, hours);
+                if (cost > space.budget) {
+                    continue;
+                }
+                char label[32];
+                std::snprintf(label, sizeof(label), "shift_%gh", hours);
+                priced.push_back({ cost, { label, machines, operators, space.runTime, operatorShift(hours, operators), modelFile } });
+            }
+        }
+    }
+    std::stable_sort(priced.begin(), priced.end(),
+        [](const std::pair<double, Scenario>& a, const std::pair<double, Scenario>& b) { return a.first < b.first; });
+    std::vector<Scenario> candidates;
+    std::vector<double> costs;
+    for (const auto& entry : priced) {
+        costs.push_back(entry.first);
+        candidates.push_back(entry.second);
+    }
+    int candidateCount = static_cast<int>(candidates.size());
+    if (candidateCount == 0) {
+        std::cout << "No configuration fits the cost budget" << std::endl;
+        return false;
+    }
+    if (static_cast<long long>(candidateCount) * space.initialReplications > space.totalReplications) {
+        std::cout << "The initial round needs " << static_cast<long long>(candidateCount) * space.initialReplications << " replications ("
+            << candidateCount << " configurations x " << space.initialReplications << " initial_replications), above the budget of "
+            << space.totalReplications << "; raise replications or narrow the search" << std::endl;
+        return false;
+    }
+    std::cout << "Optimizing " << space.objective << " over " << candidateCount << " configurations" << std::endl;
+    std::vector<CachedRun> entries;
+    if (cache != nullptr) {
+        for (const Scenario& candidate : candidates) {
+            entries.push_back(scenarioCacheEntry(candidate));
+        }
+    }
+    int cacheHits = 0;
+
+    OcbaSelector selector(candidateCount);
+    std::vector<int> planned(candidateCount, space.initialReplications);
+    int spent = 0;
+    int rounds = 0;
+    for (;;) {
+        // Runs of this round as (candidate, replication), in a fixed order
+        std::vector<std::pair<int, int>> runs;
+        for (int candidate = 0; candidate < candidateCount; candidate++) {
+            for (int replication = selector.stats(candidate).count; replication < planned[candidate]; replication++) {
+                runs.push_back({ candidate, replication });
+            }
+        }
+        if (runs.empty()) {
+            break;
+        }
+        std::vector<KpiVector> kpis(runs.size());
+        std::vector<bool> cached(runs.size(), false);
+        for (size_t run = 0; cache != nullptr && run < runs.size(); run++) {
+            const CachedRun* found = cache->find(entries[runs[run].first].config, mixSeed(baseSeed, runs[run].second));
+            if (found != nullptr) {
+                kpis[run] = found->kpis;
+                cached[run] = true;
+                cacheHits++;
+            }
+        }
+        std::atomic<size_t> nextRun{ 0 };
+        std::atomic<bool> failed{ false };
+        auto work = [&] {
+            std::unique_ptr<ManufacturingSystem> system;
+            int loaded = -1;
+            for (size_t run = nextRun++; run < runs.size() && !failed; run = nextRun++) {
+                if (cached[run]) {
+                    continue;
+                }
+                int candidate = runs[run].first;
+                if (candidate != loaded) {
+                    system.reset(new ManufacturingSystem());
+                    system->setTrace(false);
+                    if (!configureScenario(*system, candidates[candidate])) {
+                        failed = true;
+                        return;
+                    }
+                    loaded = candidate;
+                }
+                system->reset(mixSeed(baseSeed, runs[run].second));
+                system->runSimulation(space.runTime);
+                kpis[run] = system->getKpis();
+            }
+        };
+        std::vector<std::thread> threads;
+        for (int worker = 1; worker < workers; worker++) {
+            threads.emplace_back(work);
+        }
+        work();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        if (failed) {
+            return false;
+        }
+        // Every run reports the same KPIs, so the first round tells whether the objective is one
+        if (rounds == 0 && std::none_of(kpis.front().begin(), kpis.front().end(),
+            [&](const std::pair<std::string, double>& kpi) { return kpi.first == space.objective; })) {
+            std::cout << "Objective " << space.objective << " is not a KPI; use one of:";
+            for (const auto& kpi : kpis.front()) {
+                std::cout << " " << kpi.first;
+            }
+            std::cout << std::endl;
+            return false;
+        }
+        for (size_t run = 0; run < runs.size(); run++) {
+            const Scenario& candidate = candidates[runs[run].first];
+            selector.add(runs[run].first, kpiValue(kpis[run], space.objective));
+            results.addReplication(candidate.name(), runs[run].second, mixSeed(baseSeed, runs[run].second), kpis[run]);
+            if (cache != nullptr && !cached[run]) {
+                CachedRun entry = entries[runs[run].first];
+                entry.seed = mixSeed(baseSeed, runs[run].second);
+                entry.kpis = kpis[run];
+                cache->insert(entry);
+            }
+        }
+        spent += static_cast<int>(runs.size());
+        rounds++;
+
+        int budget = std::min(space.roundReplications, space.totalReplications - spent);
+        if (budget <= 0) {
+            break;
+        }
+        std::vector<int> extra = selector.allocate(budget);
+        for (int candidate = 0; candidate < candidateCount; candidate++) {
+            planned[candidate] += extra[candidate];
+        }
+    }
+
+    // Ranking by mean objective
+    std::vector<int> order(candidateCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return selector.stats(a).mean > selector.stats(b).mean; });
+    std::cout << spent << " replications in " << rounds << " rounds; probability the best is correct: "
+        << selector.probabilityCorrect(space.indifference) << std::endl;
+    if (cache != nullptr) {
+        std::cout << "Result cache: " << cacheHits << " of " << spent << " replications already simulated" << std::endl;
+    }
+    for (int rank = 0; rank < std::min(candidateCount, 5); rank++) {
+        const SampleStats& stats = selector.stats(order[rank]);
+        std::cout << rank + 1 << ". " << candidates[order[rank]].name() << ": " << space.objective << " " << stats.mean
+            << " +- " << stats.halfWidth() << " (" << stats.count << " replications), cost " << costs[order[rank]] << std::endl;
+    }
+    return true;
+}
+
+// What-if query answered from the cache instead of by simulation. A configuration cached with
+// at least two replications is answered from its own runs; any other is estimated by a
+// Gaussian process over the mean `kpi` of every cached configuration with the same model and
+// run length. The answer is flagged when its 95 % interval is wider than `tolerance` times the
+// estimate, i.e. where more simulation is needed before trusting it.
+void answerQuery(const ResultCache& cache, const Scenario& query, const std::string& kpi, double tolerance) {
+    CachedRun target = scenarioCacheEntry(query);
+    std::map<std::string, SampleStats> stats;
+    std::map<std::string, std::vector<double>> features;
+    for (const auto& entry : cache.entries()) {
+        const CachedRun& run = entry.second;
+        if (run.context == target.context) {
+            stats[run.config].add(kpiValue(run.kpis, kpi));
+            features[run.config] = run.features;
+        }
+    }
+    std::cout << query.name() << " (" << target.features[2] << " operators on duty on average), " << kpi << ": ";
+    if (stats.empty()) {
+        std::cout << "no cached runs of this model and run length, needs simulation" << std::endl;
+        return;
+    }
+
+    double mean = 0.0;
+    double halfWidth = 0.0;
+    auto exact = stats.find(target.config);
+    if (exact != stats.end() && exact->second.count >= 2) {
+        mean = exact->second.mean;
+        halfWidth = exact->second.halfWidth();
+        std::cout << mean << " +- " << halfWidth << " from " << exact->second.count << " cached replications";
+    }
+    else {
+        // Configurations run once get the average replication variance of the others
+        double pooled = 0.0;
+        int pooledCount = 0;
+        for (const auto& config : stats) {
+            if (config.second.count >= 2) {
+                pooled += config.second.variance();
+                pooledCount++;
+            }
+        }
+        pooled = pooledCount > 0 ? pooled / pooledCount : 0.0;
+        std::vector<std::vector<double>> x;
+        std::vector<double> y;
+        std::vector<double> noise;
+        for (const auto& config : stats) {
+            x.push_back(features[config.first]);
+            y.push_back(config.second.mean);
+            noise.push_back((config.second.count >= 2 ? config.second.variance() : pooled) / config.second.count);
+        }
+        GaussianProcess surrogate;
+        double deviation = 0.0;
+        if (!surrogate.fit(x, y, noise)) {
+            std::cout << "the cached results cannot be fitted, needs simulation" << std::endl;
+            return;
+        }
+        surrogate.predict(target.features, mean, deviation);
+        halfWidth = 1.96 * deviation;
+        std::cout << mean << " +- " << halfWidth << " estimated from " << stats.size() << " cached configurations";
+    }
+    if (halfWidth > tolerance * std::abs(mean)) {
+        std::cout << ", needs simulation" << std::endl;
+    }
+    else {
+        std::cout << std::endl;
+    }
+}
+
+// Full-site model: `lines` machining and assembly lines, each its own area, feeding one
+// shared quality control and packaging area over a conveyor. The areas run in parallel,
+// conservatively in windows or optimistically under Time Warp, on `threads` threads; results
+// are the same for either protocol and any thread count.
+void runSite(int lines, double runTime, unsigned long long baseSeed, int threads, bool optimistic, ResultsWriter& results) {
+    const double conveyorTime = 1.0; // hours from any line to finishing, the lines' lookahead
+    std::vector<std::unique_ptr<ManufacturingSystem>> areas;
+    for (int area = 0; area <= lines; area++) {
+        areas.emplace_back(new ManufacturingSystem());
+        areas.back()->setTrace(false);
+    }
+    ManufacturingSystem& finishing = *areas.back();
+    std::map<std::string, int> resources = finishing.getResources();
+    resources["operators"] = lines + (lines + 1) / 2;
+    finishing.setResources(resources);
+    finishing.setRawMaterialRate(0.0);
+    for (int line = 0; line < lines; line++) {
+        areas[line]->setExit(2, conveyorTime);
+    }
+    for (int area = 0; area <= lines; area++) {
+        areas[area]->reset(mixSeed(baseSeed, area));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    SiteStats stats;
+    if (optimistic) {
+        OptimisticSite<ManufacturingSystem, Transfer> site;
+        stats = runSiteAreas(site, areas, runTime, threads);
+    }
+    else {
+        ConservativeSite<ManufacturingSystem, Transfer> site;
+        stats = runSiteAreas(site, areas, runTime, threads);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Site with " << lines << " lines: " << stats.windows << (optimistic ? " GVT rounds, " : " windows, ") << stats.transfers << " transfers, "
+        << seconds << " s on " << threads << " threads" << std::endl;
+    if (optimistic) {
+        std::cout << "Time Warp: " << stats.rollbacks << " rollbacks, " << stats.undoneBatches << " batches undone, "
+            << stats.antiMessages << " anti-messages" << std::endl;
+    }
+    for (int area = 0; area <= lines; area++) {
+        std::string name = area < lines ? "site_line_" + std::to_string(area) : "site_finishing";
+        areas[area]->logData(name + ".txt");
+        results.addReplication(name, 0, areas[area]->getSeed(), areas[area]->getKpis());
+    }
+}
+
+// Three crews rotating weekly over 8-hour shifts, half-hour break, weekends off
+ShiftCalendar rotatingCalendar() {
+    ShiftCalendar rotating;
+    rotating.setCycleLength(3 * 168.0);
+    rotating.addDailyShifts(6.0, 8.0, 3, { {{"operators", 5}}, {{"operators", 4}}, {{"operators", 3}} });
+    rotating.addBreak(4.0, 0.5, { "operators" });
+    rotating.setNonWorkingDays({ 5, 6 });
+    return rotating;
+}
+
+struct GoldenCase {
+    std::string name;
+    Scenario scenario;
+    std::function<void(ManufacturingSystem&)> customize;
+};
+
+// Adds the event count and the best of three timed runs to a case's KPIs
+template <typename System>
+KpiVector timeGoldenRuns(System& system, unsigned long long seed, double runTime) {
+    double bestSeconds = 0.0;
+    for (int repeat = 0; repeat < 3; repeat++) {
+        system.reset(seed);
+        auto start = std::chrono::steady_clock::now();
+        system.runSimulation(runTime);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (repeat == 0 || seconds < bestSeconds) {
+            bestSeconds = seconds;
+        }
+    }
+    KpiVector kpis = system.getKpis();
+    kpis.push_back({ "events_processed", static_cast<double>(system.getEventsProcessed()) });
+    kpis.push_back({ goldenSpeedKpi, bestSeconds > 0.0 ? system.getEventsProcessed() / bestSeconds : 0.0 });
+    return kpis;
+}
+
+// Order book of the weighted_dispatch case: a ProductA/ProductB mix released 16 orders a day at
+// once, with due dates spread over the day. Even orders carry a weight of 1 to 4, odd ones take
+// their product's weight, so WSPT and ATC rank queues of jobs whose weights and times differ.
+std::string goldenOrderBook() {
+    std::string csv = "order_id,product_type,quantity,release_date,due_date,weight\n";
+    char line[128];
+    for (int order = 0; order < 33000; order++) {
+        bool productB = order % 3 == 0;
+        double release = 24.0 * (order / 16);
+        double due = release + (productB ? 16.0 : 12.0) + 1.5 * (order % 16);
+        std::snprintf(line, sizeof(line), "O%d,%s,1,%.1f,%.1f", order, productB ? "ProductB" : "ProductA", release, due);
+        csv += line;
+        csv += order % 2 == 0 ? "," + std::to_string(1 + (order / 2) % 4) + "\n" : "\n";
+    }
+    return csv;
+}
+
+// Chained site of the golden check: four machining areas feed an assembly area, which feeds a
+// finishing area. Areas are added downstream first, so even on one thread the assembly area
+// runs ahead of its inputs and sends products on before machining stragglers roll it back;
+// under Time Warp those products are cancelled with anti-messages. Returns every area's KPIs
+// prefixed with the area's name.
+template <typename Site>
+KpiVector runChainedSite(Site& site, unsigned long long seed, double runTime, SiteStats& stats) {
+    const int machiningAreas = 4;
+    const double conveyorTime = 1.0;
+    std::vector<std::unique_ptr<ManufacturingSystem>> areas;
+    std::vector<std::string> names = { "finishing", "assembly" };
+    for (int area = 0; area < machiningAreas + 2; area++) {
+        areas.emplace_back(new ManufacturingSystem());
+        areas.back()->setTrace(false);
+        if (area >= 2) {
+            names.push_back("machining_" + std::to_string(area - 2));
+        }
+    }
+    for (int area = 0; area < 2; area++) {
+        std::map<std::string, int> resources = areas[area]->getResources();
+        resources["operators"] = 8;
+        areas[area]->setResources(resources);
+        areas[area]->setRawMaterialRate(0.0);
+    }
+    areas[1]->setExit(2, conveyorTime);
+    for (int area = 2; area < machiningAreas + 2; area++) {
+        areas[area]->setExit(1, conveyorTime);
+    }
+    for (int area = 0; area < machiningAreas + 2; area++) {
+        areas[area]->reset(mixSeed(seed, area));
+        site.addArea(*areas[area]);
+    }
+    for (int area = 1; area < machiningAreas + 2; area++) {
+        site.connect(area, area >= 2 ? 1 : 0);
+    }
+    stats = site.run(runTime, 1);
+    KpiVector kpis;
+    for (int area = 0; area < machiningAreas + 2; area++) {
+        for (const auto& kpi : areas[area]->getKpis()) {
+            kpis.push_back({ names[area] + "." + kpi.first, kpi.second });
+        }
+    }
+    return kpis;
+}
+
+// Fixed catalogue of seeded runs for the golden-output check, sized to finish in seconds.
+// Editing a case changes its golden values, so add new cases rather than changing old ones.
+GoldenCases runGoldenCatalogue() {
+    const unsigned long long catalogueSeed = 42;
+    std::vector<GoldenCase> cases = {
+        { "baseline", { "ProductA", 10, 5, 50000.0, ShiftCalendar(), "" }, nullptr },
+        { "scarce_operators", { "ProductA", 10, 3, 50000.0, ShiftCalendar(), "" }, nullptr },
+        { "rotating_calendar", { "ProductA_rotating", 10, 5, 50000.0, rotatingCalendar(), "" }, nullptr },
+        { "dispatch_spt_edd", { "ProductA", 8, 4, 50000.0, ShiftCalendar(), "" }, [](ManufacturingSystem& system) {
+            system.setDispatchRule("assembly", DispatchRule::SPT);
+            system.setDispatchRule("quality_control", DispatchRule::EDD);
+        } },
+        { "dispatch_atc_wspt", { "ProductA", 8, 4, 50000.0, ShiftCalendar(), "" }, [](ManufacturingSystem& system) {
+            system.setDispatchRule("machining", DispatchRule::ATC);
+            system.setDispatchRule("assembly", DispatchRule::WSPT);
+        } },
+        { "finite_buffers", { "ProductA", 10, 5, 50000.0, ShiftCalendar(), "" }, [](ManufacturingSystem& system) {
+            system.setBufferCapacity("assembly", 2);
+            system.setBufferCapacity("quality_control", 1);
+        } },
+        { "inspection_outcomes", { "ProductA", 10, 5, 50000.0, ShiftCalendar(), "" }, [](ManufacturingSystem& system) {
+            system.addStageOutcome("quality_control", "scrap", 0.02);
+            system.addStageOutcome("quality_control", "assembly", 0.05);
+        } },
+        { "weighted_dispatch", { "ProductA", 8, 4, 50000.0, ShiftCalendar(), "" }, [](ManufacturingSystem& system) {
+            system.setProductWeight("ProductB", 2.0);
+            system.loadOrderText(goldenOrderBook());
+            system.setDispatchRule("machining", DispatchRule::WSPT);
+            system.setDispatchRule("assembly", DispatchRule::ATC);
+            system.setDispatchRule("quality_control", DispatchRule::WSPT);
+        } },
+    };
+    // fixed_line took the seed after the first five cases; cases added since come after it
+    const size_t fixedLineIndex = 5;
+    GoldenCases results;
+    for (size_t caseIndex = 0; caseIndex < cases.size(); caseIndex++) {
+        const GoldenCase& goldenCase = cases[caseIndex];
+        ManufacturingSystem system;
+        configureScenario(system, goldenCase.scenario);
+        if (goldenCase.customize) {
+            goldenCase.customize(system);
+        }
+        system.setTrace(false);
+        unsigned long long seed = mixSeed(catalogueSeed, caseIndex < fixedLineIndex ? caseIndex : caseIndex + 1);
+        results.push_back({ goldenCase.name, timeGoldenRuns(system, seed, goldenCase.scenario.runTime) });
+    }
+    FixedLineSystem<FlagshipLine> line({ 10, 5 });
+    results.push_back({ "fixed_line", timeGoldenRuns(line, mixSeed(catalogueSeed, fixedLineIndex), 200000.0) });
+
+    // The chained site under both protocols. Time Warp must commit exactly the conservative
+    // results; its case records how many KPIs differ (0) and how much it had to undo.
+    unsigned long long chainSeed = mixSeed(catalogueSeed, cases.size() + 1);
+    SiteStats conservativeStats;
+    ConservativeSite<ManufacturingSystem, Transfer> conservative;
+    KpiVector chain = runChainedSite(conservative, chainSeed, 2000.0, conservativeStats);
+    SiteStats optimisticStats;
+    OptimisticSite<ManufacturingSystem, Transfer> optimistic;
+    KpiVector warped = runChainedSite(optimistic, chainSeed, 2000.0, optimisticStats);
+    int mismatches = 0;
+    for (size_t kpi = 0; kpi < std::max(chain.size(), warped.size()); kpi++) {
+        mismatches += kpi >= chain.size() || kpi >= warped.size() || warped[kpi] != chain[kpi] ? 1 : 0;
+    }
+    results.push_back({ "site_chain", chain });
+    results.push_back({ "site_chain_time_warp", {
+        { "protocol_mismatches", static_cast<double>(mismatches) },
+        { "transfers", static_cast<double>(optimisticStats.transfers) },
+        { "rollbacks", static_cast<double>(optimisticStats.rollbacks) },
+        { "undone_batches", static_cast<double>(optimisticStats.undoneBatches) },
+        { "anti_messages", static_cast<double>(optimisticStats.antiMessages) } } });
+    return results;
+}
+
+int main(int argc, char* argv[]) {
+    // Usage: [model file] [--results <file>] [--append] [--metrics-port <port>] [--replications <n>]
+    //        [--fixed-line] [--seed <n>] [--workers <n>] [--site <lines> [--optimistic]]
+    //        [--golden <file> [--record] [--tolerance [<kpi prefix>=]<relative>]...]
+    //        [--optimize <space file>] [--cache <file>]
+    //        [--query <machines> <operators> <shift hours> <run time> [--kpi <name>] [--query-tolerance <relative>]]
+    //        [--coordinator <port> [--spawn <n>] [--unit-timeout <seconds>] [--idle-timeout <seconds>]] [--worker <host>:<port>]
+    std::string modelFile;
+    std::string resultsFile = "results.csv";
+    bool appendResults = false;
+    int metricsPort = 0;
+    int replications = 1;
+    bool fixedLine = false;
+    unsigned long long baseSeed = 1;
+    int workers = 1;
+    std::string goldenFile;
+    bool recordGolden = false;
+    KpiTolerances tolerances;
+    int siteLines = 0;
+    bool optimisticSite = false;
+    int coordinatorPort = 0;
+    int spawnWorkers = 0;
+    double unitTimeout = 0.0;
+    double idleTimeout = 60.0;
+    std::string coordinatorAddress;
+    std::string optimizeFile;
+    std::string cacheFile;
+    std::vector<double> query;
+    std::string queryKpi = "finished_products";
+    double queryTolerance = 0.05;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--results" && i + 1 < argc) {
+            resultsFile = argv[++i];
+        }
+        else if (arg == "--append") {
+            appendResults = true;
+        }
+        else if (arg == "--metrics-port" && i + 1 < argc) {
+            metricsPort = std::atoi(argv[++i]);
+        }
+        else if (arg == "--replications" && i + 1 < argc) {
+            replications = std::max(std::atoi(argv[++i]), 1);
+        }
+        else if (arg == "--fixed-line") {
+            fixedLine = true;
+        }
+        else if (arg == "--seed" && i + 1 < argc) {
+            baseSeed = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--workers" && i + 1 < argc) {
+            workers = std::max(std::atoi(argv[++i]), 1);
+        }
+        else if (arg == "--site" && i + 1 < argc) {
+            siteLines = std::max(std::atoi(argv[++i]), 1);
+        }
+        else if (arg == "--optimistic") {
+            optimisticSite = true;
+        }
+        else if (arg == "--coordinator" && i + 1 < argc) {
+            coordinatorPort = std::atoi(argv[++i]);
+        }
+        else if (arg == "--spawn" && i + 1 < argc) {
+            spawnWorkers = std::max(std::atoi(argv[++i]), 0);
+        }
+        else if (arg == "--unit-timeout" && i + 1 < argc) {
+            unitTimeout = std::atof(argv[++i]);
+        }
+        else if (arg == "--idle-timeout" && i + 1 < argc) {
+            idleTimeout = std::atof(argv[++i]);
+        }
+        else if (arg == "--worker" && i + 1 < argc) {
+            coordinatorAddress = argv[++i];
+        }
+        else if (arg == "--optimize" && i + 1 < argc) {
+            optimizeFile = argv[++i];
+        }
+        else if (arg == "--cache" && i + 1 < argc) {
+            cacheFile = argv[++i];
+        }
+        else if (arg == "--query" && i + 4 < argc) {
+            query.clear();
+            for (int field = 0; field < 4; field++) {
+                query.push_back(std::atof(argv[++i]));
+            }
+        }
+        else if (arg == "--kpi" && i + 1 < argc) {
+            queryKpi = argv[++i];
+        }
+        else if (arg == "--query-tolerance" && i + 1 < argc) {
+            queryTolerance = std::atof(argv[++i]);
+        }
+        else if (arg == "--golden" && i + 1 < argc) {
+            goldenFile = argv[++i];
+        }
+        else if (arg == "--record") {
+            recordGolden = true;
+        }
+        else if (arg == "--tolerance" && i + 1 < argc) {
+            if (!tolerances.parse(argv[++i])) {
+                return 1;
+            }
+        }
+        else {
+            // Optional model file with stage requirements, setup times and dispatching rules
+            modelFile = arg;
+        }
+    }
+
+    // Live metrics come from the simulation sweep only, and its counters have a single writer;
+    // an endpoint anywhere else would serve zeros and look like a stalled run
+    bool sweepOnly = goldenFile.empty() && query.empty() && coordinatorAddress.empty() && siteLines == 0
+        && optimizeFile.empty() && coordinatorPort == 0 && !fixedLine;
+    if (metricsPort > 0 && (!sweepOnly || workers > 1)) {
+        std::cout << "--metrics-port only publishes a simulation sweep with --workers 1" << std::endl;
+        return 1;
+    }
+
+    // Regression check instead of a sweep: record the catalogue's KPIs, or compare against them
+    if (!goldenFile.empty()) {
+        GoldenCases current = runGoldenCatalogue();
+        if (recordGolden) {
+            return writeGoldenFile(goldenFile, current) ? 0 : 1;
+        }
+        GoldenCases golden;
+        if (!readGoldenFile(goldenFile, golden)) {
+            return 1;
+        }
+        return compareGolden(golden, current, tolerances, std::cout) == 0 ? 0 : 1;
+    }
+
+    // A model file with errors stops the program here, before any path runs a half-read model
+    if (!modelFile.empty()) {
+        ManufacturingSystem model;
+        if (!model.loadModel(modelFile)) {
+            std::cout << "Model file " << modelFile << " has errors; nothing was run" << std::endl;
+            return 1;
+        }
+    }
+
     // Run different scenarios
-    runScenario("ProductA", 10, 5, 1000.0);
-    runScenario("ProductB", 8, 6, 1000.0);
-    runScenario("ProductA", 12, 7, 1000.0); // New Scenario
-    return 0;
+    std::vector<Scenario> scenarios = {
+        { "ProductA", 10, 5, 1000.0, ShiftCalendar(), modelFile },
+        { "ProductB", 8, 6, 1000.0, ShiftCalendar(), modelFile },
+        { "ProductA", 12, 7, 1000.0, ShiftCalendar(), modelFile }, // New Scenario
+        { "ProductA_rotating", 10, 5, 1000.0, rotatingCalendar(), modelFile }
+    };
+
+    // Results of earlier runs, reused by sweeps and optimizations and behind what-if queries
+    ResultCache cache;
+    if (!cacheFile.empty() && !cache.open(cacheFile)) {
+        return 1;
+    }
+    if (!query.empty()) {
+        if (cacheFile.empty() || query[0] < 1.0 || query[1] < 1.0 || query[2] <= 0.0 || query[2] > 24.0 || query[3] <= 0.0) {
+            std::cout << "--query needs --cache, at least one machine and operator, 0-24 shift hours and a run time" << std::endl;
+            return 1;
+        }
+        int machines = static_cast<int>(query[0]);
+        int operators = static_cast<int>(query[1]);
+        char label[32];
+        std::snprintf(label, sizeof(label), "shift_%gh", query[2]);
+        answerQuery(cache, { label, machines, operators, query[3], operatorShift(query[2], operators), modelFile }, queryKpi, queryTolerance);
+        return 0;
+    }
+
+    // A farm worker only runs what its coordinator sends and writes no results table
+    if (!coordinatorAddress.empty()) {
+        return runFarmWorkerSweep(scenarios, coordinatorAddress) ? 0 : 1;
+    }
+
+    // All replications of the sweep go to one results table
+    ResultsWriter results;
+    if (!results.open(resultsFile, appendResults)) {
+        return 1;
+    }
+
+    // Optional Prometheus endpoint to watch long runs from outside the process
+    LiveMetrics metrics;
+    MetricsExporter exporter(metrics);
+    bool exporting = metricsPort > 0 && exporter.start(metricsPort);
+
+    if (siteLines > 0) {
+        // One week of the full-site model, areas spread over the workers
+        runSite(siteLines, 168.0, baseSeed, workers, optimisticSite, results);
+    }
+    else if (!optimizeFile.empty()) {
+        OptimizationSpace space;
+        if (!space.load(optimizeFile)) {
+            return 1;
+        }
+        if (!runOptimization(space, modelFile, baseSeed, workers, results, cacheFile.empty() ? nullptr : &cache)) {
+            return 1;
+        }
+    }
+    else if (coordinatorPort > 0) {
+        if (!runFarmSweep(scenarios, replications, baseSeed, coordinatorPort, spawnWorkers, unitTimeout, idleTimeout, argv[0], modelFile, results)) {
+            return 1;
+        }
+    }
+    else if (!fixedLine) {
+        if (!runSweep(scenarios, replications, baseSeed, workers, results, exporting ? &metrics : nullptr, cacheFile.empty() ? nullptr : &cache)) {
+            return 1;
+        }
+    }
+    else {
+        for (size_t scenarioIndex = 0; scenarioIndex < scenarios.size(); scenarioIndex++) {
+            const Scenario& scenario = scenarios[scenarioIndex];
+            if (scenario.calendar.empty() && scenario.modelFile.empty()) {
+                runFixedLine(scenario, static_cast<int>(scenarioIndex), replications, baseSeed, results);
+            }
+            else {
+                std::cout << "Skipping " << scenario.name() << ": the fixed line has no model file or shift calendar" << std::endl;
+            }
+        }
+    }
+    results.close();
+    return cache.save() ? 0 : 1;
 }
@@ -0,0 +1,65 @@
+﻿#pragma once
+#include <cmath>
+#include <random>
+
+// Random numbers that come out bit for bit the same with every compiler and standard library,
+// provided floating-point contraction is off (the program turns it off before any include).
+// std::mt19937_64 is fully specified by the standard, but the std:: distributions are not
+// (libstdc++ and MSVC draw different exponentials from the same engine), so the
+// distributions are done here with IEEE basic operations only.
+
+// SplitMix64 finalizer: turns (base seed, stream number) into an independent engine seed
+inline unsigned long long mixSeed(unsigned long long base, unsigned long long stream) {
+    unsigned long long z = base + 0x9E3779B97F4A7C15ULL * (stream + 1);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Natural logarithm for x > 0 from frexp and an atanh series, so it does not depend on the
+// C runtime's log (which is not correctly rounded everywhere)
+inline double portableLog(double x) {
+    int exponent = 0;
+    double mantissa = std::frexp(x, &exponent); // [0.5, 1), exact
+    if (mantissa < 0.70710678118654752) {
+        mantissa *= 2.0;
+        exponent--;
+    }
+    // log(m) = 2 atanh(s) with s = (m - 1) / (m + 1), |s| < 0.172
+    double s = (mantissa - 1.0) / (mantissa + 1.0);
+    double s2 = s * s;
+    double series = 1.0 / 23.0;
+    for (int k = 21; k >= 1; k -= 2) {
+        series = 1.0 / k + s2 * series;
+    }
+    const double ln2High = 6.93147180369123816490e-01; // ln 2 split so exponent * ln2High is exact
+    const double ln2Low = 1.90821492927058770002e-10;
+    return exponent * ln2High + (exponent * ln2Low + 2.0 * s * series);
+}
+
+class RandomStream {
+private:
+    std::mt19937_64 engine;
+
+public:
+    explicit RandomStream(unsigned long long seed = 0)
+        : engine(seed) {
+    }
+
+    void seed(unsigned long long seed) {
+        engine.seed(seed);
+    }
+
+    // Uniform on [0, 1) with 53 random bits
+    double uniform() {
+        return static_cast<double>(engine() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    double uniform(double low, double high) {
+        return low + (high - low) * uniform();
+    }
+
+    double exponential(double rate) {
+        return -portableLog(1.0 - uniform()) / rate;
+    }
+};
@@ -0,0 +1,151 @@
+﻿#pragma once
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Running mean and variance of one candidate's replications (Welford)
+struct SampleStats {
+    int count = 0;
+    double mean = 0.0;
+    double squares = 0.0; // sum of squared deviations from the mean
+
+    void add(double value) {
+        count++;
+        double delta = value - mean;
+        mean += delta / count;
+        squares += delta * (value - mean);
+    }
+
+    double variance() const {
+        return count > 1 ? squares / (count - 1) : 0.0;
+    }
+
+    // Half-width of the normal-approximation 95 % confidence interval of the mean
+    double halfWidth() const {
+        return count > 1 ? 1.96 * std::sqrt(variance() / count) : 0.0;
+    }
+};
+
+// Ranking and selection by OCBA (optimal computing budget allocation, Chen et al. 2000) for the
+// candidate with the largest mean. Each round the next replications go where they raise the
+// probability of correct selection most: to close competitors with noisy results and to the
+// current best, in the asymptotically optimal ratios
+//   N_i / N_j = (s_i / d_i)^2 / (s_j / d_j)^2,   N_b = s_b * sqrt(sum over i != b of N_i^2 / s_i^2)
+// where d_i is the gap between candidate i and the best b.
+class OcbaSelector {
+private:
+    std::vector<SampleStats> candidates;
+
+    // Floors that keep the ratios finite for exact ties and noise-free candidates
+    double minimumDeviation() const {
+        double largest = 0.0;
+        for (const auto& candidate : candidates) {
+            largest = std::max(largest, std::sqrt(candidate.variance()));
+        }
+        return largest > 0.0 ? largest * 1e-3 : 1e-9;
+    }
+
+public:
+    explicit OcbaSelector(int count)
+        : candidates(count) {
+    }
+
+    void add(int candidate, double value) {
+        candidates[candidate].add(value);
+    }
+
+    const SampleStats& stats(int candidate) const {
+        return candidates[candidate];
+    }
+
+    int size() const {
+        return static_cast<int>(candidates.size());
+    }
+
+    // Ties go to the lower index, so the choice does not depend on floating-point noise in order
+    int best() const {
+        int best = 0;
+        for (int candidate = 1; candidate < size(); candidate++) {
+            if (candidates[candidate].mean > candidates[best].mean) {
+                best = candidate;
+            }
+        }
+        return best;
+    }
+
+    // Replications to add to each candidate, `budget` in total, moving the allocation toward the
+    // OCBA ratios for the new total. Candidates already above their share get none.
+    std::vector<int> allocate(int budget) const {
+        int count = size();
+        std::vector<int> extra(count, 0);
+        if (count == 0 || budget <= 0) {
+            return extra;
+        }
+        int total = budget;
+        for (const auto& candidate : candidates) {
+            total += candidate.count;
+        }
+        int b = best();
+        double floor = minimumDeviation();
+        std::vector<double> weight(count, 0.0);
+        double bestDeviation = std::max(std::sqrt(candidates[b].variance()), floor);
+        double sumSquares = 0.0;
+        for (int i = 0; i < count; i++) {
+            if (i == b) {
+                continue;
+            }
+            double deviation = std::max(std::sqrt(candidates[i].variance()), floor);
+            double gap = std::max(candidates[b].mean - candidates[i].mean, floor);
+            weight[i] = (deviation / gap) * (deviation / gap);
+            sumSquares += weight[i] * weight[i] / (deviation * deviation);
+        }
+        weight[b] = count > 1 ? bestDeviation * std::sqrt(sumSquares) : 1.0;
+
+        // Ideal counts for the new total; the shortfalls are shared out by largest remainder
+        double weightSum = 0.0;
+        for (double w : weight) {
+            weightSum += w;
+        }
+        std::vector<double> shortfall(count, 0.0);
+        double shortfallSum = 0.0;
+        for (int i = 0; i < count; i++) {
+            shortfall[i] = std::max(0.0, total * weight[i] / weightSum - candidates[i].count);
+            shortfallSum += shortfall[i];
+        }
+        if (shortfallSum <= 0.0) {
+            extra[b] = budget;
+            return extra;
+        }
+        std::vector<std::pair<double, int>> remainders;
+        int given = 0;
+        for (int i = 0; i < count; i++) {
+            double share = budget * shortfall[i] / shortfallSum;
+            extra[i] = static_cast<int>(share);
+            given += extra[i];
+            remainders.push_back({ extra[i] - share, i });
+        }
+        std::sort(remainders.begin(), remainders.end());
+        for (size_t i = 0; given < budget; i = (i + 1) % remainders.size()) {
+            extra[remainders[i].second]++;
+            given++;
+        }
+        return extra;
+    }
+
+    // Approximate probability that no candidate beats best() by more than `indifference`
+    // (Bonferroni bound over normal gaps)
+    double probabilityCorrect(double indifference = 0.0) const {
+        int b = best();
+        double probability = 1.0;
+        for (int i = 0; i < size(); i++) {
+            if (i == b || candidates[i].count < 2 || candidates[b].count < 2) {
+                continue;
+            }
+            double spread = std::sqrt(candidates[b].variance() / candidates[b].count + candidates[i].variance() / candidates[i].count);
+            double gap = candidates[b].mean - candidates[i].mean + indifference;
+            double wrong = spread > 0.0 ? 0.5 * std::erfc(gap / spread / std::sqrt(2.0)) : (gap > 0.0 ? 0.0 : 0.5);
+            probability -= wrong;
+        }
+        return std::max(probability, 0.0);
+    }
+};
@@ -0,0 +1,390 @@
+﻿#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ResultsWriter.h"
+#include "Sockets.h"
+
+// Replication farm: a coordinator hands work units to worker processes over TCP, on one machine
+// or across nodes, and collects their KPIs. The protocol is one text line per message:
+//   worker:      hello <fingerprint>     then per unit  kpi <name> <value> ... done <unit>
+//   coordinator: run <unit> <request>    quit when every unit has a result, bye to a stranger
+// A worker that disconnects or overruns the unit timeout is dropped and its unit handed out
+// again, so a run finishes as long as some worker is left; with none left past the idle timeout
+// the coordinator gives up.
+
+// Connected socket with a buffer for the partial line read so far
+class LineSocket {
+private:
+    SocketHandle handle = INVALID_SOCKET;
+    std::string pending;
+
+public:
+    explicit LineSocket(SocketHandle socket = INVALID_SOCKET)
+        : handle(socket) {
+    }
+
+    ~LineSocket() {
+        close();
+    }
+
+    LineSocket(const LineSocket&) = delete;
+    LineSocket& operator=(const LineSocket&) = delete;
+
+    bool isOpen() const {
+        return handle != INVALID_SOCKET;
+    }
+
+    SocketHandle get() const {
+        return handle;
+    }
+
+    void attach(SocketHandle socket) {
+        close();
+        handle = socket;
+        pending.clear();
+    }
+
+    void close() {
+        if (handle != INVALID_SOCKET) {
+            CLOSE_SOCKET(handle);
+            handle = INVALID_SOCKET;
+        }
+    }
+
+    bool send(const std::string& lines) {
+        return sendAll(handle, lines);
+    }
+
+    // Appends whatever has arrived, blocking until something does; false once the peer is gone
+    bool receive() {
+        char buffer[4096];
+        int count = recv(handle, buffer, sizeof(buffer), 0);
+        if (count <= 0) {
+            return false;
+        }
+        pending.append(buffer, static_cast<size_t>(count));
+        return true;
+    }
+
+    // Takes the next complete line, without its newline
+    bool nextLine(std::string& line) {
+        size_t end = pending.find('\n');
+        if (end == std::string::npos) {
+            return false;
+        }
+        line.assign(pending, 0, end);
+        pending.erase(0, end + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        return true;
+    }
+};
+
+struct FarmStats {
+    int workersSeen = 0;
+    int workersLost = 0;
+    int unitsRequeued = 0;
+};
+
+class FarmCoordinator {
+private:
+    struct Worker {
+        LineSocket socket;
+        bool greeted = false;
+        int unit = -1; // unit being run, -1 while idle
+        KpiVector kpis;
+        std::chrono::steady_clock::time_point started;
+
+        explicit Worker(SocketHandle handle)
+            : socket(handle) {
+        }
+    };
+
+    std::string fingerprint; // workers must run the same scenarios and model on the same simulator version
+    double unitTimeout = 0.0; // seconds, 0 waits for ever
+    double idleTimeout = 60.0; // seconds without any greeted worker, 0 waits for ever
+    SocketHandle listener = INVALID_SOCKET;
+    int port = 0;
+
+public:
+    explicit FarmCoordinator(const std::string& sweepFingerprint)
+        : fingerprint(sweepFingerprint) {
+    }
+
+    ~FarmCoordinator() {
+        close();
+    }
+
+    FarmCoordinator(const FarmCoordinator&) = delete;
+    FarmCoordinator& operator=(const FarmCoordinator&) = delete;
+
+    // Drops a worker that has not reported a unit after `seconds`, e.g. on a node that hangs
+    void setUnitTimeout(double seconds) {
+        unitTimeout = seconds;
+    }
+
+    // Gives up once no greeted worker has been connected for `seconds`, e.g. when every worker
+    // has died; otherwise the coordinator would wait for ever
+    void setIdleTimeout(double seconds) {
+        idleTimeout = seconds;
+    }
+
+    // Listens on `listenPort` on every interface. Call it before starting workers, so that they
+    // find the port open.
+    bool listen(int listenPort) {
+        if (!startSockets()) {
+            return false;
+        }
+        port = listenPort;
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        int reuse = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<unsigned short>(port));
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (listener == INVALID_SOCKET || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listener, 16) != 0) {
+            std::cout << "Could not coordinate on port " << port << std::endl;
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (listener != INVALID_SOCKET) {
+            CLOSE_SOCKET(listener);
+            listener = INVALID_SOCKET;
+            stopSockets();
+        }
+    }
+
+    // Serves units 0 .. units-1 until each has a result; describe(unit) is the request sent for
+    // it. results[unit] are the unit's KPIs. False if listen failed or every worker was lost.
+    bool run(int units, const std::function<std::string(int)>& describe, std::vector<KpiVector>& results, FarmStats& stats) {
+        if (listener == INVALID_SOCKET) {
+            return false;
+        }
+        std::cout << "Coordinating " << units << " units on port " << port << std::endl;
+
+        results.assign(units, KpiVector());
+        std::vector<bool> finished(units, false);
+        std::deque<int> queue;
+        for (int unit = 0; unit < units; unit++) {
+            queue.push_back(unit);
+        }
+        int finishedCount = 0;
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::string line;
+        auto lastWorker = std::chrono::steady_clock::now(); // last time a greeted worker was connected
+
+        auto drop = [&](Worker& worker, const char* reason) {
+            worker.socket.close();
+            if (!worker.greeted) {
+                return;
+            }
+            stats.workersLost++;
+            if (worker.unit >= 0) {
+                std::cout << "Worker " << reason << ", unit " << worker.unit << " handed out again" << std::endl;
+                queue.push_front(worker.unit);
+                stats.unitsRequeued++;
+                worker.unit = -1;
+            }
+        };
+
+        while (finishedCount < units) {
+            fd_set readable;
+            FD_ZERO(&readable);
+            FD_SET(listener, &readable);
+            SocketHandle highest = listener;
+            for (const auto& worker : workers) {
+                FD_SET(worker->socket.get(), &readable);
+                highest = std::max(highest, worker->socket.get());
+            }
+            timeval timeout = { 0, 200000 };
+            if (select(static_cast<int>(highest) + 1, &readable, nullptr, nullptr, &timeout) < 0) {
+                continue;
+            }
+            if (FD_ISSET(listener, &readable)) {
+                SocketHandle client = accept(listener, nullptr, nullptr);
+                if (client != INVALID_SOCKET) {
+                    workers.emplace_back(new Worker(client));
+                }
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            for (auto& entry : workers) {
+                Worker& worker = *entry;
+                if (FD_ISSET(worker.socket.get(), &readable) && !worker.socket.receive()) {
+                    drop(worker, "disconnected");
+                    continue;
+                }
+                while (worker.socket.isOpen() && worker.socket.nextLine(line)) {
+                    // Results only count from a greeted worker, for the unit it was sent
+                    if (line.compare(0, 4, "kpi ") == 0) {
+                        size_t space = line.find(' ', 4);
+                        if (worker.greeted && worker.unit >= 0 && space != std::string::npos) {
+                            worker.kpis.push_back({ line.substr(4, space - 4), std::strtod(line.c_str() + space + 1, nullptr) });
+                        }
+                    }
+                    else if (line.compare(0, 5, "done ") == 0) {
+                        char* end = nullptr;
+                        long unit = std::strtol(line.c_str() + 5, &end, 10);
+                        if (!worker.greeted || worker.unit < 0 || end == line.c_str() + 5 || *end != '\0'
+                            || unit < 0 || unit >= units || unit != worker.unit) {
+                            std::cout << "Rejected a result for unit " << line.substr(5) << std::endl;
+                            drop(worker, "sent a result for another unit");
+                            break;
+                        }
+                        if (!finished[unit]) {
+                            results[unit].swap(worker.kpis);
+                            finished[unit] = true;
+                            finishedCount++;
+                        }
+                        worker.kpis.clear();
+                        worker.unit = -1;
+                    }
+                    else if (line.compare(0, 6, "hello ") == 0) {
+                        if (line.substr(6) != fingerprint) {
+                            std::cout << "Rejected a worker running other scenarios, another model or another simulator version" << std::endl;
+                            worker.socket.send("bye\n");
+                            drop(worker, "rejected");
+                            break;
+                        }
+                        worker.greeted = true;
+                        stats.workersSeen++;
+                    }
+                }
+                if (worker.socket.isOpen() && worker.unit >= 0 && unitTimeout > 0.0
+                    && std::chrono::duration<double>(now - worker.started).count() > unitTimeout) {
+                    drop(worker, "timed out");
+                }
+            }
+
+            // A unit requeued after its worker was dropped may have been finished by then
+            while (!queue.empty() && finished[queue.front()]) {
+                queue.pop_front();
+            }
+            for (auto& entry : workers) {
+                Worker& worker = *entry;
+                if (queue.empty()) {
+                    break;
+                }
+                if (!worker.socket.isOpen() || !worker.greeted || worker.unit >= 0) {
+                    continue;
+                }
+                worker.unit = queue.front();
+                queue.pop_front();
+                worker.started = now;
+                worker.kpis.clear();
+                if (!worker.socket.send("run " + std::to_string(worker.unit) + " " + describe(worker.unit) + "\n")) {
+                    drop(worker, "unreachable");
+                }
+            }
+            workers.erase(std::remove_if(workers.begin(), workers.end(),
+                [](const std::unique_ptr<Worker>& worker) { return !worker->socket.isOpen(); }), workers.end());
+
+            if (std::any_of(workers.begin(), workers.end(), [](const std::unique_ptr<Worker>& worker) { return worker->greeted; })) {
+                lastWorker = now;
+            }
+            else if (idleTimeout > 0.0 && std::chrono::duration<double>(now - lastWorker).count() > idleTimeout) {
+                std::cout << "No worker for " << idleTimeout << " s, giving up with " << finishedCount << " of " << units << " units done" << std::endl;
+                break;
+            }
+        }
+
+        for (auto& worker : workers) {
+            worker->socket.send("quit\n");
+        }
+        workers.clear();
+        close();
+        return finishedCount == units;
+    }
+};
+
+// Runs units for the coordinator at host:port until it says quit. The connection is retried
+// for a few seconds so workers can start before the coordinator listens. runUnit(request, kpis)
+// does one unit; returning false ends the worker and the coordinator hands the unit to another.
+inline bool runFarmWorker(const std::string& host, int port, const std::string& fingerprint,
+    const std::function<bool(const std::string&, KpiVector&)>& runUnit) {
+    if (!startSockets()) {
+        return false;
+    }
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* address = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &address) != 0) {
+        std::cout << "Unknown coordinator host " << host << std::endl;
+        stopSockets();
+        return false;
+    }
+    LineSocket connection;
+    for (int attempt = 0; attempt < 50 && !connection.isOpen(); attempt++) {
+        SocketHandle handle = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (handle != INVALID_SOCKET && connect(handle, address->ai_addr, static_cast<int>(address->ai_addrlen)) == 0) {
+            connection.attach(handle);
+            break;
+        }
+        if (handle != INVALID_SOCKET) {
+            CLOSE_SOCKET(handle);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    freeaddrinfo(address);
+    if (!connection.isOpen()) {
+        std::cout << "Could not reach the coordinator at " << host << ":" << port << std::endl;
+        stopSockets();
+        return false;
+    }
+
+    bool ok = connection.send("hello " + fingerprint + "\n");
+    std::string line;
+    KpiVector kpis;
+    std::string reply;
+    char number[32];
+    while (ok) {
+        if (!connection.nextLine(line)) {
+            ok = connection.receive();
+            continue;
+        }
+        if (line == "quit") {
+            break;
+        }
+        if (line == "bye") {
+            std::cout << "The coordinator runs other scenarios, another model or another simulator version than this worker" << std::endl;
+            ok = false;
+            break;
+        }
+        if (line.compare(0, 4, "run ") != 0) {
+            continue;
+        }
+        size_t space = line.find(' ', 4);
+        std::string unit = line.substr(4, space == std::string::npos ? std::string::npos : space - 4);
+        kpis.clear();
+        if (!runUnit(space == std::string::npos ? std::string() : line.substr(space + 1), kpis)) {
+            ok = false;
+            break;
+        }
+        reply.clear();
+        for (const auto& kpi : kpis) {
+            std::snprintf(number, sizeof(number), " %.17g\n", kpi.second);
+            reply += "kpi " + kpi.first + number;
+        }
+        reply += "done " + unit + "\n";
+        ok = connection.send(reply);
+    }
+    connection.close();
+    stopSockets();
+    return ok;
+}
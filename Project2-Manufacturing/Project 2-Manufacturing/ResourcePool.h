@@ -0,0 +1,126 @@
+﻿#pragma once
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+struct ResourceDemand {
+    int pool;
+    int units;
+};
+
+// Everything a stage has to hold at the same time, e.g. one machine and one operator
+typedef std::vector<ResourceDemand> SeizeSet;
+
+// Counted resource pools with all-or-nothing seizing. A stage that cannot start is parked on the
+// first pool it is short of, so a release only wakes the stages waiting on that pool instead of
+// rescanning every queue.
+class ResourcePools {
+private:
+    struct Pool {
+        std::string name;
+        int available = 0;
+    };
+    std::pmr::vector<Pool> pools;
+    std::pmr::vector<std::pmr::vector<int>> blockedStages; // per pool
+    std::pmr::vector<int> stageBlockedOn; // pool each stage is parked on, -1 if none
+
+    template <typename WakeList>
+    void wake(int pool, WakeList& wakeList) {
+        for (int stage : blockedStages[pool]) {
+            stageBlockedOn[stage] = -1;
+            wakeList.push_back(stage);
+        }
+        blockedStages[pool].clear();
+    }
+
+public:
+    explicit ResourcePools(std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+        : pools(memory), blockedStages(memory), stageBlockedOn(memory) {
+    }
+
+    void clear(int stageCount) {
+        pools.clear();
+        blockedStages.clear();
+        stageBlockedOn.assign(stageCount, -1);
+    }
+
+    // Forgets every parked stage; the caller sets the capacities again
+    void reset() {
+        for (auto& stages : blockedStages) {
+            stages.clear();
+        }
+        stageBlockedOn.assign(stageBlockedOn.size(), -1);
+    }
+
+    int addPool(const std::string& name, int capacity) {
+        Pool pool;
+        pool.name = name;
+        pool.available = capacity;
+        pools.push_back(pool);
+        blockedStages.emplace_back();
+        return static_cast<int>(pools.size()) - 1;
+    }
+
+    int find(const std::string& name) const {
+        for (size_t i = 0; i < pools.size(); i++) {
+            if (pools[i].name == name) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    // Takes every demand of the set, or nothing. Returns -1 on success, otherwise the pool that is short.
+    int trySeize(const SeizeSet& seizeSet) {
+        for (const auto& demand : seizeSet) {
+            if (pools[demand.pool].available < demand.units) {
+                return demand.pool;
+            }
+        }
+        for (const auto& demand : seizeSet) {
+            pools[demand.pool].available -= demand.units;
+        }
+        return -1;
+    }
+
+    // Returns the units and appends the stages that were waiting on those pools to wakeList
+    template <typename WakeList>
+    void release(const SeizeSet& seizeSet, WakeList& wakeList) {
+        for (const auto& demand : seizeSet) {
+            pools[demand.pool].available += demand.units;
+            wake(demand.pool, wakeList);
+        }
+    }
+
+    // Capacity change from the shift calendar; availability may go negative while units are still busy
+    template <typename WakeList>
+    void adjust(int pool, int delta, WakeList& wakeList) {
+        pools[pool].available += delta;
+        if (delta > 0) {
+            wake(pool, wakeList);
+        }
+    }
+
+    void block(int pool, int stage) {
+        if (stageBlockedOn[stage] < 0) {
+            stageBlockedOn[stage] = pool;
+            blockedStages[pool].push_back(stage);
+        }
+    }
+
+    int available(int pool) const {
+        return pools[pool].available;
+    }
+
+    void setAvailable(int pool, int units) {
+        pools[pool].available = units;
+    }
+
+    const std::string& name(int pool) const {
+        return pools[pool].name;
+    }
+
+    int size() const {
+        return static_cast<int>(pools.size());
+    }
+};
@@ -0,0 +1,148 @@
+﻿#pragma once
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ResultsWriter.h"
+
+// Part of every key; bump it when a simulator change alters results, so older entries are not reused
+const char* const resultCacheVersion = "3";
+
+// 64-bit FNV-1a, chained through `hash` so several pieces can go into one key
+inline unsigned long long fnv1a(const std::string& text, unsigned long long hash = 14695981039346656037ULL) {
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+inline std::string hashText(unsigned long long hash) {
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx", hash);
+    return text;
+}
+
+// One cached replication: its configuration (for the surrogate) and its KPIs
+struct CachedRun {
+    std::string config;  // hash of model, run length and scenario parameters, without the seed
+    std::string context; // hash of what configurations must share to be compared: model and run length
+    unsigned long long seed = 0;
+    std::vector<double> features; // numeric description of the configuration
+    KpiVector kpis;
+};
+
+// Persistent results of earlier runs, one line per replication, keyed by the hash of the
+// configuration and the seed:
+//   <run key> <config> <context> <seed> <feature count> <features...> <kpi count> <name value...>
+// New runs are kept in memory and appended to the file by save().
+class ResultCache {
+private:
+    std::string filename;
+    std::map<std::string, CachedRun> runs;
+    std::vector<std::string> added;
+
+public:
+    static std::string runKey(const std::string& config, unsigned long long seed) {
+        return hashText(fnv1a(std::to_string(seed), fnv1a(config)));
+    }
+
+    // A missing file is an empty cache
+    bool open(const std::string& cacheFile) {
+        filename = cacheFile;
+        runs.clear();
+        added.clear();
+        std::ifstream file(filename);
+        if (!file.is_open()) {
+            return true;
+        }
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(file, line)) {
+            lineNumber++;
+            std::istringstream fields(line);
+            std::string key;
+            CachedRun run;
+            size_t featureCount = 0;
+            size_t kpiCount = 0;
+            if (!(fields >> key >> run.config >> run.context >> run.seed >> featureCount)) {
+                continue;
+            }
+            run.features.resize(featureCount);
+            bool ok = true;
+            for (double& feature : run.features) {
+                ok = ok && static_cast<bool>(fields >> feature);
+            }
+            ok = ok && static_cast<bool>(fields >> kpiCount);
+            for (size_t i = 0; ok && i < kpiCount; i++) {
+                std::string name;
+                double value = 0.0;
+                ok = static_cast<bool>(fields >> name >> value);
+                run.kpis.push_back({ name, value });
+            }
+            if (!ok) {
+                std::cout << filename << ":" << lineNumber << ": damaged cache entry skipped" << std::endl;
+                continue;
+            }
+            runs[key] = run;
+        }
+        return true;
+    }
+
+    const CachedRun* find(const std::string& config, unsigned long long seed) const {
+        auto found = runs.find(runKey(config, seed));
+        return found == runs.end() ? nullptr : &found->second;
+    }
+
+    void insert(const CachedRun& run) {
+        std::string key = runKey(run.config, run.seed);
+        if (runs.emplace(key, run).second) {
+            added.push_back(key);
+        }
+    }
+
+    const std::map<std::string, CachedRun>& entries() const {
+        return runs;
+    }
+
+    size_t size() const {
+        return runs.size();
+    }
+
+    size_t newRuns() const {
+        return added.size();
+    }
+
+    bool save() {
+        if (added.empty()) {
+            return true;
+        }
+        std::ofstream file(filename, std::ios::app);
+        if (!file.is_open()) {
+            std::cout << "Could not write result cache " << filename << std::endl;
+            return false;
+        }
+        std::string buffer;
+        char number[32];
+        for (const std::string& key : added) {
+            const CachedRun& run = runs[key];
+            buffer += key + " " + run.config + " " + run.context + " " + std::to_string(run.seed) + " " + std::to_string(run.features.size());
+            for (double feature : run.features) {
+                std::snprintf(number, sizeof(number), " %.17g", feature);
+                buffer += number;
+            }
+            buffer += " " + std::to_string(run.kpis.size());
+            for (const auto& kpi : run.kpis) {
+                std::snprintf(number, sizeof(number), " %.17g", kpi.second);
+                buffer += " " + kpi.first + number;
+            }
+            buffer += "\n";
+        }
+        file << buffer;
+        added.clear();
+        return true;
+    }
+};
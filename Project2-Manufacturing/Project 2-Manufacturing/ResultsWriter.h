@@ -0,0 +1,116 @@
+﻿#pragma once
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+typedef std::vector<std::pair<std::string, double>> KpiVector;
+
+// Long-format results table for a whole sweep: one row per (scenario, replication, KPI).
+// Rows are formatted into a memory buffer and written in large batches; with append the
+// rows are added to an existing dataset that has the same columns.
+class ResultsWriter {
+private:
+    std::ofstream file;
+    std::string buffer;
+    size_t batchBytes = 1 << 20;
+    long long rowsWritten = 0;
+
+    void appendField(const std::string& text) {
+        // Quote only when needed so the common case stays a plain copy
+        if (text.find_first_of(",\"\n") == std::string::npos) {
+            buffer += text;
+            return;
+        }
+        buffer += '"';
+        for (char c : text) {
+            if (c == '"') {
+                buffer += '"';
+            }
+            buffer += c;
+        }
+        buffer += '"';
+    }
+
+public:
+    static const char* header() {
+        return "scenario,replication,seed,kpi,value\n";
+    }
+
+    ~ResultsWriter() {
+        close();
+    }
+
+    bool open(const std::string& filename, bool append = false) {
+        close();
+        bool writeHeader = true;
+        if (append) {
+            std::ifstream existing(filename);
+            std::string firstLine;
+            if (std::getline(existing, firstLine)) {
+                if (!firstLine.empty() && firstLine.back() == '\r') {
+                    firstLine.pop_back();
+                }
+                if (firstLine + "\n" != header()) {
+                    std::cout << "Cannot append to " << filename << ": columns differ" << std::endl;
+                    return false;
+                }
+                writeHeader = false;
+            }
+        }
+        file.open(filename, append ? std::ios::app : std::ios::trunc);
+        if (!file.is_open()) {
+            std::cout << "Could not open results file " << filename << std::endl;
+            return false;
+        }
+        buffer.reserve(batchBytes + 4096);
+        if (writeHeader) {
+            buffer += header();
+        }
+        return true;
+    }
+
+    void addRow(const std::string& scenario, int replication, unsigned long long seed, const std::string& kpi, double value) {
+        char numbers[96];
+        appendField(scenario);
+        std::snprintf(numbers, sizeof(numbers), ",%d,%llu,", replication, seed);
+        buffer += numbers;
+        appendField(kpi);
+        std::snprintf(numbers, sizeof(numbers), ",%.17g\n", value);
+        buffer += numbers;
+        rowsWritten++;
+        if (buffer.size() >= batchBytes) {
+            flush();
+        }
+    }
+
+    void addReplication(const std::string& scenario, int replication, unsigned long long seed, const KpiVector& kpis) {
+        for (const auto& kpi : kpis) {
+            addRow(scenario, replication, seed, kpi.first, kpi.second);
+        }
+    }
+
+    void flush() {
+        if (file.is_open() && !buffer.empty()) {
+            file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            buffer.clear();
+        }
+    }
+
+    void close() {
+        flush();
+        if (file.is_open()) {
+            file.close();
+        }
+    }
+
+    bool isOpen() const {
+        return file.is_open();
+    }
+
+    long long rows() const {
+        return rowsWritten;
+    }
+};
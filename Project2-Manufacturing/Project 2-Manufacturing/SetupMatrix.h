@@ -0,0 +1,41 @@
+﻿#pragma once
+#include <vector>
+
+// Sequence-dependent setup times stored densely as (from-product x to-product), with an extra
+// "from" row for machines that have not been set up for anything yet
+class SetupMatrix {
+private:
+    int productCount = 0;
+    std::vector<double> times;
+
+    size_t index(int from, int to) const {
+        return static_cast<size_t>(from < 0 ? productCount : from) * productCount + to;
+    }
+
+public:
+    enum { NoProduct = -1 };
+
+    // Every changeover defaults to the initial setup time of the product being set up,
+    // running the same product again needs no setup
+    void reset(const std::vector<double>& initialSetupTimes) {
+        productCount = static_cast<int>(initialSetupTimes.size());
+        times.assign(static_cast<size_t>(productCount + 1) * productCount, 0.0);
+        for (int from = NoProduct; from < productCount; from++) {
+            for (int to = 0; to < productCount; to++) {
+                times[index(from, to)] = from == to ? 0.0 : initialSetupTimes[to];
+            }
+        }
+    }
+
+    void set(int from, int to, double time) {
+        times[index(from, to)] = time;
+    }
+
+    double get(int from, int to) const {
+        return times[index(from, to)];
+    }
+
+    int size() const {
+        return productCount;
+    }
+};
@@ -0,0 +1,62 @@
+﻿#pragma once
+#include <string>
+
+// Socket headers and the few calls that differ between Winsock and POSIX
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+typedef SOCKET SocketHandle;
+#define CLOSE_SOCKET closesocket
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int SocketHandle;
+#define INVALID_SOCKET (-1)
+#define CLOSE_SOCKET ::close
+#endif
+
+// Winsock must be started before any socket call; the calls are counted, so every user pairs
+// its own start and stop
+inline bool startSockets() {
+#ifdef _WIN32
+    WSADATA wsaData;
+    return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+#else
+    return true;
+#endif
+}
+
+inline void stopSockets() {
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+// Sends the whole buffer; a peer that has gone away fails the call instead of raising SIGPIPE
+inline bool sendAll(SocketHandle socket, const std::string& data) {
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    size_t sent = 0;
+    while (sent < data.size()) {
+        int count = send(socket, data.data() + sent, static_cast<int>(data.size() - sent), flags);
+        if (count <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(count);
+    }
+    return true;
+}
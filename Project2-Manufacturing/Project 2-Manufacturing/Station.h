@@ -0,0 +1,192 @@
+﻿#pragma once
+#include <memory_resource>
+#include <string>
+#include <vector>
+#include "SetupMatrix.h"
+
+enum class ServerState { Idle, Setup, Busy, Down };
+
+// One machine (or other unit) of a station
+struct Server {
+    ServerState state = ServerState::Idle;
+    int station = 0;
+    int currentJob = -1;
+    int lastProduct = SetupMatrix::NoProduct;
+    double busySince = 0.0;
+    double busyTime = 0.0;
+    int idleSlot = -1; // position in the station's idle bucket, -1 when not idle
+};
+
+struct Station {
+    std::string name;
+    int firstServer = 0;
+    int serverCount = 0;
+    int idleCount = 0;
+    int firstBucket = 0; // first of the station's idle buckets in StationModel
+};
+
+// All servers live in one array, grouped by station
+class StationModel {
+private:
+    std::pmr::vector<Server> servers;
+    std::pmr::vector<Station> stations;
+    // Idle servers of each station bucketed by the product they are set up for
+    // (bucket 0 = never set up), so a server without changeover is found in O(1)
+    std::pmr::vector<std::pmr::vector<int>> idleBuckets;
+    int productCount = 0;
+
+    std::pmr::vector<int>& bucket(int station, int product) {
+        return idleBuckets[stations[station].firstBucket + product + 1];
+    }
+
+    std::pmr::vector<int>& bucketOf(const Server& server) {
+        return bucket(server.station, server.lastProduct);
+    }
+
+    void pushIdle(int id) {
+        Server& server = servers[id];
+        std::pmr::vector<int>& idle = bucketOf(server);
+        server.state = ServerState::Idle;
+        server.idleSlot = static_cast<int>(idle.size());
+        idle.push_back(id);
+        stations[server.station].idleCount++;
+    }
+
+    void removeIdle(int id) {
+        Server& server = servers[id];
+        std::pmr::vector<int>& idle = bucketOf(server);
+        int moved = idle.back();
+        idle[server.idleSlot] = moved;
+        servers[moved].idleSlot = server.idleSlot;
+        idle.pop_back();
+        server.idleSlot = -1;
+        stations[server.station].idleCount--;
+    }
+
+public:
+    explicit StationModel(std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+        : servers(memory), stations(memory), idleBuckets(memory) {
+    }
+
+    void clear(int products) {
+        servers.clear();
+        stations.clear();
+        idleBuckets.clear();
+        productCount = products;
+    }
+
+    // Puts every server back to idle and never set up, keeping the station layout
+    void reset() {
+        for (auto& idle : idleBuckets) {
+            idle.clear();
+        }
+        for (auto& station : stations) {
+            station.idleCount = 0;
+        }
+        for (size_t id = 0; id < servers.size(); id++) {
+            Server& server = servers[id];
+            server.currentJob = -1;
+            server.lastProduct = SetupMatrix::NoProduct;
+            server.busySince = 0.0;
+            server.busyTime = 0.0;
+            pushIdle(static_cast<int>(id));
+        }
+    }
+
+    int addStation(const std::string& name, int serverCount) {
+        Station station;
+        station.name = name;
+        station.firstServer = static_cast<int>(servers.size());
+        station.serverCount = serverCount;
+        station.firstBucket = static_cast<int>(idleBuckets.size());
+        idleBuckets.resize(idleBuckets.size() + productCount + 1);
+        stations.push_back(station);
+        int stationId = static_cast<int>(stations.size()) - 1;
+        for (int i = 0; i < serverCount; i++) {
+            Server server;
+            server.station = stationId;
+            servers.push_back(server);
+            pushIdle(static_cast<int>(servers.size()) - 1);
+        }
+        return stationId;
+    }
+
+    int findStation(const std::string& name) const {
+        for (size_t i = 0; i < stations.size(); i++) {
+            if (stations[i].name == name) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    int idleCount(int station) const {
+        return stations[station].idleCount;
+    }
+
+    // Takes the idle server with the cheapest setup for `product`, or returns -1 if none is idle
+    int acquire(int station, int product, int job, double now, const SetupMatrix& setupMatrix) {
+        if (stations[station].idleCount == 0) {
+            return -1;
+        }
+        int chosen = -1;
+        if (!bucket(station, product).empty()) {
+            chosen = bucket(station, product).back();
+        }
+        else {
+            double cheapest = 0.0;
+            for (int from = SetupMatrix::NoProduct; from < productCount; from++) {
+                const std::pmr::vector<int>& idle = bucket(station, from);
+                if (!idle.empty() && (chosen < 0 || setupMatrix.get(from, product) < cheapest)) {
+                    chosen = idle.back();
+                    cheapest = setupMatrix.get(from, product);
+                }
+            }
+        }
+        removeIdle(chosen);
+        Server& server = servers[chosen];
+        server.state = ServerState::Setup;
+        server.currentJob = job;
+        server.busySince = now;
+        return chosen;
+    }
+
+    void startProcessing(int id) {
+        servers[id].state = ServerState::Busy;
+    }
+
+    void release(int id, double now) {
+        Server& server = servers[id];
+        server.busyTime += now - server.busySince;
+        server.currentJob = -1;
+        pushIdle(id);
+    }
+
+    // Takes an idle server out of service; busy servers finish their job first
+    bool setDown(int id) {
+        if (servers[id].state != ServerState::Idle) {
+            return false;
+        }
+        removeIdle(id);
+        servers[id].state = ServerState::Down;
+        return true;
+    }
+
+    void setUp(int id) {
+        if (servers[id].state == ServerState::Down) {
+            pushIdle(id);
+        }
+    }
+
+    Server& server(int id) {
+        return servers[id];
+    }
+
+    const Station& station(int id) const {
+        return stations[id];
+    }
+
+    int stationCount() const {
+        return static_cast<int>(stations.size());
+    }
+};
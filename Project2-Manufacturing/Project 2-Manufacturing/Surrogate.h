@@ -0,0 +1,174 @@
+﻿#pragma once
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+// Gaussian-process (kriging) surrogate over configurations that have been simulated. Inputs are
+// scaled to [0, 1] per dimension and outputs standardized; the kernel is squared exponential
+// with one length scale per fit, picked from a grid by the log marginal likelihood. Each point
+// carries its own noise variance (the variance of its replication mean), so configurations run
+// more often pull the fit harder.
+class GaussianProcess {
+private:
+    std::vector<std::vector<double>> points; // scaled inputs
+    std::vector<double> low;
+    std::vector<double> range;
+    double outputMean = 0.0;
+    double outputScale = 1.0;
+    double lengthScale = 0.3;
+    std::vector<double> alpha; // K^-1 y
+    std::vector<double> cholesky; // lower triangle of K, row-major n x n
+
+    std::vector<double> scale(const std::vector<double>& x) const {
+        std::vector<double> scaled(x.size());
+        for (size_t d = 0; d < x.size(); d++) {
+            scaled[d] = (x[d] - low[d]) / range[d];
+        }
+        return scaled;
+    }
+
+    double kernel(const std::vector<double>& a, const std::vector<double>& b, double length) const {
+        double distance = 0.0;
+        for (size_t d = 0; d < a.size(); d++) {
+            double gap = (a[d] - b[d]) / length;
+            distance += gap * gap;
+        }
+        return std::exp(-0.5 * distance);
+    }
+
+    // Factors K = L L^T in place; false if K is not positive definite
+    static bool factor(std::vector<double>& matrix, size_t n) {
+        for (size_t j = 0; j < n; j++) {
+            double diagonal = matrix[j * n + j];
+            for (size_t k = 0; k < j; k++) {
+                diagonal -= matrix[j * n + k] * matrix[j * n + k];
+            }
+            if (diagonal <= 0.0) {
+                return false;
+            }
+            diagonal = std::sqrt(diagonal);
+            matrix[j * n + j] = diagonal;
+            for (size_t i = j + 1; i < n; i++) {
+                double value = matrix[i * n + j];
+                for (size_t k = 0; k < j; k++) {
+                    value -= matrix[i * n + k] * matrix[j * n + k];
+                }
+                matrix[i * n + j] = value / diagonal;
+            }
+        }
+        return true;
+    }
+
+    // Solves L z = b
+    static std::vector<double> forward(const std::vector<double>& lower, size_t n, std::vector<double> b) {
+        for (size_t i = 0; i < n; i++) {
+            for (size_t k = 0; k < i; k++) {
+                b[i] -= lower[i * n + k] * b[k];
+            }
+            b[i] /= lower[i * n + i];
+        }
+        return b;
+    }
+
+    // Solves L^T z = b
+    static std::vector<double> backward(const std::vector<double>& lower, size_t n, std::vector<double> b) {
+        for (size_t i = n; i-- > 0;) {
+            for (size_t k = i + 1; k < n; k++) {
+                b[i] -= lower[k * n + i] * b[k];
+            }
+            b[i] /= lower[i * n + i];
+        }
+        return b;
+    }
+
+public:
+    // x: configurations, y: mean result of each, noise: variance of each mean (0 if unknown)
+    bool fit(const std::vector<std::vector<double>>& x, const std::vector<double>& y, const std::vector<double>& noise) {
+        size_t n = x.size();
+        if (n == 0) {
+            return false;
+        }
+        size_t dimensions = x[0].size();
+        low.assign(dimensions, std::numeric_limits<double>::infinity());
+        std::vector<double> high(dimensions, -std::numeric_limits<double>::infinity());
+        for (const auto& point : x) {
+            for (size_t d = 0; d < dimensions; d++) {
+                low[d] = std::min(low[d], point[d]);
+                high[d] = std::max(high[d], point[d]);
+            }
+        }
+        range.resize(dimensions);
+        for (size_t d = 0; d < dimensions; d++) {
+            range[d] = high[d] > low[d] ? high[d] - low[d] : 1.0;
+        }
+        points.clear();
+        for (const auto& point : x) {
+            points.push_back(scale(point));
+        }
+        outputMean = 0.0;
+        for (double value : y) {
+            outputMean += value;
+        }
+        outputMean /= n;
+        double spread = 0.0;
+        for (double value : y) {
+            spread += (value - outputMean) * (value - outputMean);
+        }
+        outputScale = n > 1 && spread > 0.0 ? std::sqrt(spread / (n - 1)) : 1.0;
+        std::vector<double> standardized(n);
+        for (size_t i = 0; i < n; i++) {
+            standardized[i] = (y[i] - outputMean) / outputScale;
+        }
+
+        double bestLikelihood = -std::numeric_limits<double>::infinity();
+        for (double length : { 0.05, 0.1, 0.2, 0.3, 0.5, 0.8, 1.2, 2.0 }) {
+            std::vector<double> matrix(n * n);
+            for (size_t i = 0; i < n; i++) {
+                for (size_t j = 0; j <= i; j++) {
+                    matrix[i * n + j] = matrix[j * n + i] = kernel(points[i], points[j], length);
+                }
+                // A small nugget keeps K well conditioned when points nearly coincide
+                matrix[i * n + i] += noise[i] / (outputScale * outputScale) + 1e-6;
+            }
+            if (!factor(matrix, n)) {
+                continue;
+            }
+            std::vector<double> weights = backward(matrix, n, forward(matrix, n, standardized));
+            double likelihood = 0.0;
+            for (size_t i = 0; i < n; i++) {
+                likelihood -= 0.5 * standardized[i] * weights[i] + std::log(matrix[i * n + i]);
+            }
+            if (likelihood > bestLikelihood) {
+                bestLikelihood = likelihood;
+                lengthScale = length;
+                alpha = weights;
+                cholesky = matrix;
+            }
+        }
+        return !alpha.empty();
+    }
+
+    // Posterior mean and standard deviation of the latent response at x
+    void predict(const std::vector<double>& x, double& mean, double& deviation) const {
+        size_t n = points.size();
+        std::vector<double> scaled = scale(x);
+        std::vector<double> covariance(n);
+        double standardizedMean = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            covariance[i] = kernel(scaled, points[i], lengthScale);
+            standardizedMean += covariance[i] * alpha[i];
+        }
+        std::vector<double> v = forward(cholesky, n, covariance);
+        double variance = 1.0;
+        for (double value : v) {
+            variance -= value * value;
+        }
+        mean = outputMean + outputScale * standardizedMean;
+        deviation = outputScale * std::sqrt(std::max(variance, 0.0));
+    }
+
+    double getLengthScale() const {
+        return lengthScale;
+    }
+};
@@ -0,0 +1,105 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Periodic KPI snapshots kept column by column in buffers sized up front. With a bucket size
+// above 1, consecutive samples are folded into one row of min/max/mean per column as they
+// arrive, so long runs only keep one row per bucket.
+class TimeSeriesRecorder {
+private:
+    std::vector<std::string> columns;
+    int bucketSize = 1;
+    std::vector<double> times; // start of each bucket
+    std::vector<std::vector<double>> minimum;
+    std::vector<std::vector<double>> maximum;
+    std::vector<std::vector<double>> sum;
+    std::vector<int> counts;
+    int inBucket = 0;
+
+public:
+    void configure(const std::vector<std::string>& names, double interval, int samplesPerBucket, double runTime) {
+        columns = names;
+        bucketSize = std::max(samplesPerBucket, 1);
+        size_t rows = interval > 0.0 ? static_cast<size_t>(runTime / interval / bucketSize) + 2 : 0;
+        times.clear();
+        times.reserve(rows);
+        counts.clear();
+        counts.reserve(rows);
+        minimum.resize(columns.size());
+        maximum.resize(columns.size());
+        sum.resize(columns.size());
+        for (size_t column = 0; column < columns.size(); column++) {
+            // Cleared rather than replaced so a reused recorder keeps its buffers
+            minimum[column].clear();
+            maximum[column].clear();
+            sum[column].clear();
+            minimum[column].reserve(rows);
+            maximum[column].reserve(rows);
+            sum[column].reserve(rows);
+        }
+        inBucket = 0;
+    }
+
+    void record(double time, const std::vector<double>& sample) {
+        if (inBucket == 0) {
+            times.push_back(time);
+            counts.push_back(0);
+            for (size_t column = 0; column < columns.size(); column++) {
+                minimum[column].push_back(sample[column]);
+                maximum[column].push_back(sample[column]);
+                sum[column].push_back(0.0);
+            }
+        }
+        for (size_t column = 0; column < columns.size(); column++) {
+            minimum[column].back() = std::min(minimum[column].back(), sample[column]);
+            maximum[column].back() = std::max(maximum[column].back(), sample[column]);
+            sum[column].back() += sample[column];
+        }
+        counts.back()++;
+        inBucket = (inBucket + 1) % bucketSize;
+    }
+
+    size_t rows() const {
+        return times.size();
+    }
+
+    // Without downsampling there is one value column per KPI, otherwise <kpi>_min/_max/_mean
+    bool writeCsv(const std::string& filename) const {
+        std::ofstream file(filename);
+        if (!file.is_open()) {
+            std::cout << "Could not open time series file " << filename << std::endl;
+            return false;
+        }
+        std::string buffer = "time";
+        for (const auto& name : columns) {
+            buffer += bucketSize == 1 ? "," + name : "," + name + "_min," + name + "_max," + name + "_mean";
+        }
+        buffer += "\n";
+        char number[32];
+        for (size_t row = 0; row < times.size(); row++) {
+            std::snprintf(number, sizeof(number), "%.10g", times[row]);
+            buffer += number;
+            for (size_t column = 0; column < columns.size(); column++) {
+                double mean = sum[column][row] / counts[row];
+                if (bucketSize == 1) {
+                    std::snprintf(number, sizeof(number), ",%.10g", mean);
+                    buffer += number;
+                    continue;
+                }
+                std::snprintf(number, sizeof(number), ",%.10g", minimum[column][row]);
+                buffer += number;
+                std::snprintf(number, sizeof(number), ",%.10g", maximum[column][row]);
+                buffer += number;
+                std::snprintf(number, sizeof(number), ",%.10g", mean);
+                buffer += number;
+            }
+            buffer += "\n";
+        }
+        file << buffer;
+        return true;
+    }
+};